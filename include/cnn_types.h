@@ -19,14 +19,30 @@
 // PE Array dimensions (m × n) - REDUCED FOR XCZU1CG
 // Original: 24×36 = 864 PEs (needs 864 DSPs) - TOO LARGE
 // New: 8×12 = 96 PEs (needs 96 DSPs) - FITS IN XCZU1CG
+// INT8 build (-DCNN_INT8, see build_hls.tcl): two PEs share each DSP48E2,
+// so 8×24 = 192 PEs fit in the same 96 DSPs
+#ifdef CNN_INT8
+#define M_SIZE 8           // Number of rows in PE array (even: rows pair up)
+#define N_SIZE 24          // Number of columns in PE array
+#define MACS_PER_DSP 2     // Two int8 multiplies sharing the weight operand
+#else
 #define M_SIZE 8           // Number of rows in PE array (was 24)
 #define N_SIZE 12          // Number of columns in PE array (was 36)  
+#define MACS_PER_DSP 1
+#endif
 #define TOTAL_PES (M_SIZE * N_SIZE)  // 96 PEs total (fits in 240 DSPs)
+#define TOTAL_DSPS (TOTAL_PES / MACS_PER_DSP)  // 96 DSPs in either build
 
 // Data Width Configuration
+#ifdef CNN_INT8
+#define DATA_WIDTH 8        // 8-bit fixed-point
+#define INT_BITS 4          // Integer bits
+#define FRAC_BITS 4         // Fractional bits
+#else
 #define DATA_WIDTH 16       // 16-bit fixed-point
 #define INT_BITS 8          // Integer bits
 #define FRAC_BITS 8         // Fractional bits
+#endif
 
 // Memory Configuration
 #define WEIGHT_MEM_DEPTH 256        // Weights per PE (z parameter)
@@ -41,6 +57,31 @@
 // Layer Configuration
 #define MAX_LAYERS 50               // Maximum CNN layers
 
+// AXI4-Stream Configuration (override with -DAXIS_WIDTH=..., see build_hls.tcl)
+#ifndef AXIS_WIDTH
+#define AXIS_WIDTH 128              // Packed beat width: 64, 128, 256 or 512 bits
+#endif
+#define AXIS_LANES (AXIS_WIDTH / DATA_WIDTH)  // data_t lanes per beat
+
+// FC streaming: weight beats per input element (one weight per PE)
+#define FC_BEATS_PER_INPUT ((TOTAL_PES + AXIS_LANES - 1) / AXIS_LANES)
+
+// FC batching: every streamed weight beat is applied to up to FC_BATCH_MAX
+// images of a batch (one accumulator per image in each PE), so an FC layer's
+// weights are streamed once per FC_BATCH_MAX images
+#define FC_BATCH_MAX 4
+
+// DDR Master Configuration (m_axi mode)
+#define DMA_MAX_BURST 256           // Beats per AXI4 INCR burst
+
+// On-chip Activation Buffer (two ping-pong banks for intermediate layers)
+#define ACT_BUF_SIZE 32768                       // data_t elements per bank
+#define ACT_BUF_DEPTH (ACT_BUF_SIZE / AXIS_LANES) // Beats per bank
+
+// On-chip Skip Buffer (one saved map for residual adds)
+#define SKIP_BUF_SIZE 32768                        // data_t elements
+#define SKIP_BUF_DEPTH (SKIP_BUF_SIZE / AXIS_LANES) // Beats
+
 // Classification
 #define MAX_CLASSES 1000            // ImageNet-1K classes
 
@@ -49,8 +90,45 @@
  ******************************************************************************/
 
 // Fixed-point data type: ap_fixed<16, 8> = 8 integer bits, 8 fractional bits
+// (ap_fixed<8, 4> in the INT8 build)
 typedef ap_fixed<DATA_WIDTH, INT_BITS> data_t;
 
+// Full-precision MAC product
+typedef ap_fixed<2 * DATA_WIDTH, 2 * INT_BITS> product_t;
+
+// MAC accumulator: full-precision products plus 16 guard bits, i.e. the
+// 48-bit DSP48E2 P register in the 16-bit build (32 bits in the INT8 build),
+// so deep kernels accumulate in one pass. The PE output requantises it per
+// layer (scale, shift, round, saturate) back to data_t
+#define ACC_WIDTH (2 * DATA_WIDTH + 16)
+#define ACC_INT_BITS (2 * INT_BITS + 16)
+typedef ap_fixed<ACC_WIDTH, ACC_INT_BITS> acc_t;
+typedef ap_fixed<DATA_WIDTH, INT_BITS, AP_RND, AP_SAT> requant_t;
+
+// Requantisation scale, 0 <= scale < 2 (1.0 = identity)
+typedef ap_ufixed<16, 1> scale_t;
+
+// Average pooling: window sums keep 12 extra integer bits (windows of up to
+// MAX_POOL_WINDOW = 4096 inputs), scaled by a reciprocal when the window is
+// not a power of two
+#define MAX_POOL_WINDOW 4096
+typedef ap_fixed<DATA_WIDTH + 12, INT_BITS + 12> pool_sum_t;
+typedef ap_ufixed<16, 0> recip_t;
+
+// Bits needed to count from 0 to n inclusive (n < 2^24)
+#define COUNT_BITS(n) ((n) < 2 ? 1 : (n) < 4 ? 2 : (n) < 8 ? 3 : (n) < 16 ? 4 : \
+                       (n) < 32 ? 5 : (n) < 64 ? 6 : (n) < 128 ? 7 : (n) < 256 ? 8 : \
+                       (n) < 512 ? 9 : (n) < 1024 ? 10 : (n) < 2048 ? 11 : (n) < 4096 ? 12 : \
+                       (n) < 8192 ? 13 : (n) < 16384 ? 14 : (n) < 32768 ? 15 : (n) < 65536 ? 16 : \
+                       (n) < 131072 ? 17 : (n) < 262144 ? 18 : (n) < 524288 ? 19 : (n) < 1048576 ? 20 : \
+                       (n) < 2097152 ? 21 : (n) < 4194304 ? 22 : (n) < 8388608 ? 23 : 24)
+
+// Values written to one line-memory row (0 .. LINE_MEM_WIDTH)
+typedef ap_uint<COUNT_BITS(LINE_MEM_WIDTH)> row_count_t;
+
+// Inputs per MAX/AVG window (0 .. MAX_POOL_WINDOW)
+typedef ap_uint<COUNT_BITS(MAX_POOL_WINDOW)> window_t;
+
 // Address types
 typedef ap_uint<10> addr_t;         // Up to 1024 addresses
 typedef ap_uint<16> large_addr_t;   // For larger memory spaces
@@ -59,6 +137,19 @@ typedef ap_uint<16> large_addr_t;   // For larger memory spaces
 typedef ap_uint<8> idx_t;           // General indexing (0-255)
 typedef ap_uint<12> large_idx_t;    // Larger indices (0-4095)
 
+// Sparse weight metadata: one byte per stored (non-zero) weight
+//   [4:0] line offset - line memory holding the matching input
+//   [5]   group end   - last stored weight for the current input vector
+typedef ap_uint<8> weight_meta_t;
+#define META_LINE(m)      ((m).range(4, 0))
+#define META_GROUP_END(m) ((m)[5] == 1)
+
+// Packed AXI4-Stream beat: AXIS_LANES data_t values per transfer
+// Lane 0 holds the first (lowest-addressed) element
+struct axis_beat_t {
+    data_t lane[AXIS_LANES];
+};
+
 /******************************************************************************
  * LAYER TYPE ENUMERATION
  ******************************************************************************/
@@ -69,9 +160,44 @@ typedef enum {
     MAXPOOL = 2,    // Max pooling layer
     AVGPOOL = 3,    // Average pooling layer
     RELU = 4,       // ReLU activation
-    RELU6 = 5       // ReLU6 activation (clipped at 6)
+    RELU6 = 5,      // ReLU6 activation (clipped at 6)
+    DWCONV = 6,     // Depthwise convolution (one channel per PE column)
+    GAVGPOOL = 7,   // Global average pooling (one output per channel)
+    ELTWISE_ADD = 8 // Input plus the saved skip map (residual join)
 } layer_type_t;
 
+/******************************************************************************
+ * PE OPERATION ENUMERATION
+ ******************************************************************************/
+
+typedef enum {
+    PE_OP_MAC = 0,  // Multiply-accumulate against the weight memory
+    PE_OP_MAX = 1,  // Max over the window (MAX module)
+    PE_OP_AVG = 2   // Window sum on the MAC adder, scaled to the mean
+} pe_op_t;
+
+/******************************************************************************
+ * FUSED ACTIVATION ENUMERATION
+ ******************************************************************************/
+
+typedef enum {
+    ACT_NONE = 0,   // Linear output (PE sign override)
+    ACT_RELU = 1,   // ReLU via the PE sign-and-zero detector
+    ACT_RELU6 = 2   // ReLU6 (ReLU in the PE, clip at output collection)
+} activation_t;
+
+/******************************************************************************
+ * DATAFLOW ENUMERATION (CONV layers)
+ ******************************************************************************/
+
+typedef enum {
+    DATAFLOW_OUTPUT_STATIONARY = 0, // Each PE holds the whole filter and
+                                    // accumulates complete outputs
+    DATAFLOW_WEIGHT_STATIONARY = 1  // Each PE row holds one kernel row; a
+                                    // row group's raw partial sums are added
+                                    // in one step at output collection
+} dataflow_t;
+
 /******************************************************************************
  * LAYER CONFIGURATION STRUCTURE
  ******************************************************************************/
@@ -100,6 +226,37 @@ struct LayerConfig {
     ap_uint<3> stride;          // Stride (1, 2, 3, etc.)
     ap_uint<3> padding;         // Padding (0, 1, 2, 3)
     
+    // Grouped convolution: input channels and filters split into groups
+    // (kernel_d = input_c / groups, nl counts the filter groups of all
+    // groups, each padded to whole N_SIZE columns)
+    ap_uint<11> groups;         // 1 = ordinary convolution
+    
+    // PE mapping of a CONV layer (see IS_WEIGHT_STATIONARY)
+    dataflow_t dataflow;
+    
+    // Fused post-processing for CONV/FC layers. With pool_size > 1 the
+    // output dimensions above are the pooled ones
+    activation_t activation;    // Activation applied before pooling
+    ap_uint<3> pool_size;       // Max-pool window (1 = no pooling)
+    ap_uint<3> pool_stride;     // Max-pool stride (pool_size <= 2*pool_stride)
+    
+    // Output requantisation: activation = sat(round(acc * out_scale >> out_shift)).
+    // Biases are added in the accumulator, before the scale and shift
+    ap_uint<5> out_shift;       // Right shift (0 = none)
+    scale_t out_scale;          // Multiplier (1.0 = none)
+    
+    // Residual connections through the on-chip skip buffer
+    bool save_output;           // Keep this layer's output for a later add
+    bool add_residual;          // Add the saved map before the activation
+    
+    // Skip MACs on zero input activations (set for layers fed by a ReLU)
+    bool zero_skip;
+    
+    // Compressed (pruned) weights: stored entries per filter, 0 = dense.
+    // Each input vector's group is padded to the same entry count across
+    // filters so that all PE columns advance the line memories together
+    ap_uint<10> weight_entries;
+    
     // Iteration control
     ap_uint<16> nl;             // Number of iterations for this layer
     ap_uint<10> rl;             // Minimum data required for pre-fetch
@@ -108,15 +265,82 @@ struct LayerConfig {
     bool is_fc_last;            // True if this is the last FC layer (FClast)
     ap_uint<12> num_classes;    // Number of classes (for FClast layer)
     
+    // DDR base addresses for m_axi mode, in axis_beat_t units
+    ap_uint<32> input_base;     // Input feature map
+    ap_uint<32> weight_base;    // Weights: nl groups of N_SIZE beat-aligned filters
+    ap_uint<32> bias_base;      // Biases: nl groups of N_SIZE values, beat-aligned
+    ap_uint<32> output_base;    // Output feature map
+    
+    // Batch layout: beats between consecutive images of a batch
+    ap_uint<32> input_batch_stride;
+    ap_uint<32> output_batch_stride;
+    
     // Constructor for initialization
     LayerConfig() :
         layer_type(CONV),
         kernel_h(3), kernel_w(3), kernel_d(3), num_filters(64),
         input_h(224), input_w(224), input_c(3),
         output_h(224), output_w(224), output_c(64),
-        stride(1), padding(1),
+        stride(1), padding(1), groups(1),
+        dataflow(DATAFLOW_OUTPUT_STATIONARY),
+        activation(ACT_RELU), pool_size(1), pool_stride(1),
+        out_shift(0), out_scale(1),
+        save_output(false), add_residual(false),
+        zero_skip(false), weight_entries(0),
         nl(1), rl(1),
-        is_fc_last(false), num_classes(1000)
+        is_fc_last(false), num_classes(1000),
+        input_base(0), weight_base(0), bias_base(0), output_base(0),
+        input_batch_stride(0), output_batch_stride(0)
+    {}
+};
+
+/******************************************************************************
+ * ACTIVATION ROUTING (on-chip ping-pong activation buffer)
+ ******************************************************************************/
+
+struct ActivationRoute {
+    bool src_on_chip;           // Layer input comes from the activation buffer
+    ap_uint<1> src_bank;        // Bank holding the layer input
+    bool dst_on_chip;           // Layer output goes to the activation buffer
+    ap_uint<1> dst_bank;        // Bank receiving the layer output
+    bool skip_save;             // Output is also kept in the skip buffer
+    bool skip_add;              // Skip buffer is added before the activation
+    
+    // Constructor (default: both ends cross the AXI boundary)
+    ActivationRoute() :
+        src_on_chip(false), src_bank(0),
+        dst_on_chip(false), dst_bank(0),
+        skip_save(false), skip_add(false)
+    {}
+};
+
+/******************************************************************************
+ * DMA REQUEST STRUCTURE (m_axi DDR master mode)
+ ******************************************************************************/
+
+struct DMARequest {
+    // Input feature map burst
+    bool input_valid;           // Burst requested this cycle
+    ap_uint<32> input_addr;     // DDR beat address
+    ap_uint<16> input_beats;    // Burst length in beats
+    
+    // Filter-group weight and bias bursts
+    bool weight_valid;          // Burst requested this cycle
+    ap_uint<32> weight_addr;    // DDR beat address of the group's weights
+    ap_uint<16> weight_beats;   // Weight burst length in beats
+    ap_uint<32> bias_addr;      // DDR beat address of the group's biases
+    bool bias_valid;            // Bias burst follows (not for FC streaming)
+    
+    // Output write-back
+    bool output_restart;        // New layer/pass: restart write-back at output_addr
+    ap_uint<32> output_addr;    // DDR beat address of the layer output
+    
+    // Constructor
+    DMARequest() :
+        input_valid(false), input_addr(0), input_beats(0),
+        weight_valid(false), weight_addr(0), weight_beats(0), bias_addr(0),
+        bias_valid(false),
+        output_restart(false), output_addr(0)
     {}
 };
 
@@ -129,7 +353,17 @@ struct PEConfig {
     ap_uint<5> line_select;     // 0 to M_SIZE-1
     
     // Operation mode
-    bool mac_max_mode;          // true = MAC operation, false = MAX operation
+    pe_op_t op;                 // MAC, MAX or AVG
+    
+    // Pooling window (MAX/AVG): inputs per output and the AVG scaling
+    window_t window_size;
+    bool avg_pow2;              // window_size == 1 << avg_shift
+    ap_uint<4> avg_shift;
+    recip_t avg_recip;          // 1 / window_size otherwise
+    
+    // Output requantisation (layer's out_shift / out_scale)
+    ap_uint<5> out_shift;
+    scale_t out_scale;
     
     // Sign control
     bool sign_override;         // Override sign detection for first layer
@@ -138,13 +372,38 @@ struct PEConfig {
     bool enable;                // Enable PE computation
     bool reset;                 // Reset accumulator
     
+    // Ping-pong weight memory
+    ap_uint<1> weight_bank;     // Bank feeding the MAC (other bank loads)
+    
+    // Padding
+    bool pad_input;             // Selected input row lies in the zero padding
+    
+    // Back-to-back outputs: restart from bias_psum in the cycle an output
+    // completes instead of spending a reset cycle (pointwise GEMM mode)
+    bool continuous;
+    
+    // Sparsity
+    bool zero_skip;             // Skip MAC and weight read on zero inputs
+    bool sparse;                // Weight memory holds compressed entries
+    
     // Constructor
     PEConfig() :
         line_select(0),
-        mac_max_mode(true),
+        op(PE_OP_MAC),
+        window_size(1),
+        avg_pow2(true),
+        avg_shift(0),
+        avg_recip(0),
+        out_shift(0),
+        out_scale(1),
         sign_override(false),
         enable(true),
-        reset(false)
+        reset(false),
+        weight_bank(0),
+        pad_input(false),
+        continuous(false),
+        zero_skip(false),
+        sparse(false)
     {}
 };
 
@@ -158,7 +417,9 @@ typedef enum {
     KPC_COMPUTE = 2,    // Computing
     KPC_STRIDE_H = 3,   // Horizontal stride
     KPC_STRIDE_V = 4,   // Vertical stride
-    KPC_DONE = 5        // Computation done
+    KPC_DONE = 5,       // Computation done
+    KPC_LOAD_WEIGHTS = 6, // Loading filter weights into PE weight memories
+    KPC_LOAD_BIAS = 7   // Loading per-filter biases for the iteration
 } kpc_state_t;
 
 /******************************************************************************
@@ -220,6 +481,67 @@ struct ComputeStats {
 // Convert to fixed-point constant
 #define TO_FIXED(x) ((data_t)(x))
 
+// Most negative data_t value (MAX pooling start value)
+#define DATA_MIN ((data_t)(-(1 << (INT_BITS - 1))))
+
+// 1×1 stride-1 unpadded convolution: runs as a channel-dimension GEMM
+#define IS_POINTWISE(cfg) ((cfg).layer_type == CONV && (cfg).kernel_h == 1 && \
+                           (cfg).kernel_w == 1 && (cfg).stride == 1 && (cfg).padding == 0)
+
+// Weight-stationary mapping: dense spatial CONV layers whose kernel rows
+// fit the PE rows; other layers ignore the dataflow selector. INT8 PE pairs
+// share one weight, so that build always runs output-stationary
+#define IS_WEIGHT_STATIONARY(cfg) ((cfg).dataflow == DATAFLOW_WEIGHT_STATIONARY && \
+                                   (cfg).layer_type == CONV && !IS_POINTWISE(cfg) && \
+                                   (cfg).weight_entries == 0 && \
+                                   (cfg).kernel_h <= M_SIZE && MACS_PER_DSP == 1)
+
+// Weights one PE holds for one output: the stored entries of a compressed
+// filter, a depthwise filter's single channel, one kernel row in
+// weight-stationary mode
+#define PE_FILTER_SIZE(cfg) ((cfg).weight_entries != 0 ? (ap_uint<20>)(cfg).weight_entries : \
+                             (cfg).layer_type == DWCONV ? \
+                             (ap_uint<20>)((cfg).kernel_h * (cfg).kernel_w) : \
+                             IS_WEIGHT_STATIONARY(cfg) ? \
+                             (ap_uint<20>)((cfg).kernel_w * (cfg).kernel_d) : \
+                             (ap_uint<20>)((cfg).kernel_h * (cfg).kernel_w * (cfg).kernel_d))
+
+// Deepest pointwise layer: a line-memory bank holds two pixel channel
+// vectors (one computed while the next is written), and each channel is one
+// weight of the PE's filter
+#define PW_MAX_DEPTH ((LINE_MEM_WIDTH / 2 < WEIGHT_MEM_DEPTH) ? LINE_MEM_WIDTH / 2 : \
+                      WEIGHT_MEM_DEPTH)
+
+// Every PE column owns one channel and walks its own window: depthwise
+// convolution and windowed max/average pooling
+#define IS_CHANNEL_WISE(cfg) ((cfg).layer_type == DWCONV || \
+                              (cfg).layer_type == MAXPOOL || (cfg).layer_type == AVGPOOL)
+
+// Channel-wise rows interleave N_SIZE channels per pixel in one line-memory
+// bank, and their output rows are assembled in buffers of the same width
+#define CW_ROWS_FIT(cfg) ((cfg).input_w * N_SIZE <= LINE_MEM_WIDTH && \
+                          (cfg).output_w * N_SIZE <= LINE_MEM_WIDTH)
+
+// Layer configurations the datapath cannot execute. The IEC stops at the
+// first one with final_class = -1 and layer_out naming the layer.
+// A filter must fit the PE weight memory (FC layers stream theirs);
+// pointwise layers are at most PW_MAX_DEPTH deep; depthwise and pooling
+// rows must fit a line memory and leave the array unpooled; global pools
+// sum at most MAX_POOL_WINDOW pixels; the residual add walks the skip map
+// in unpooled output order, so it cannot follow a fused pool
+#define LAYER_UNSUPPORTED(cfg) ((((cfg).layer_type == CONV || (cfg).layer_type == DWCONV) && \
+                                 PE_FILTER_SIZE(cfg) > WEIGHT_MEM_DEPTH) || \
+                                (IS_POINTWISE(cfg) && (cfg).kernel_d > PW_MAX_DEPTH) || \
+                                (IS_CHANNEL_WISE(cfg) && \
+                                 (!CW_ROWS_FIT(cfg) || (cfg).pool_size > 1)) || \
+                                ((cfg).layer_type == GAVGPOOL && \
+                                 (cfg).input_h * (cfg).input_w > MAX_POOL_WINDOW) || \
+                                ((cfg).add_residual && (cfg).pool_size > 1))
+
+// Pooling and element-wise layers carry no weights or biases
+#define IS_WEIGHTLESS(cfg) ((cfg).layer_type == MAXPOOL || (cfg).layer_type == AVGPOOL || \
+                            (cfg).layer_type == GAVGPOOL || (cfg).layer_type == ELTWISE_ADD)
+
 /******************************************************************************
  * ASSERTIONS FOR PARAMETER VALIDATION
  ******************************************************************************/
@@ -228,8 +550,17 @@ struct ComputeStats {
 #define STATIC_ASSERT(condition, message) \
     typedef char static_assert_##message[(condition) ? 1 : -1]
 
-// PE array size must fit in device (xczu1cg has 240 DSPs)
-STATIC_ASSERT((M_SIZE * N_SIZE <= 200), pe_array_too_large_for_xczu1cg);
+// Line-memory addresses and row widths are 10-bit (addr_t)
+STATIC_ASSERT((LINE_MEM_WIDTH <= 1023), line_mem_width_exceeds_addr_t);
+
+// PE array DSPs must fit in device (xczu1cg has 240 DSPs)
+STATIC_ASSERT((TOTAL_DSPS <= 200), pe_array_too_large_for_xczu1cg);
+
+#ifdef CNN_INT8
+// INT8 PEs pair up row-wise on one DSP48E2 (FC streaming: column-wise)
+STATIC_ASSERT((M_SIZE % 2 == 0), int8_rows_must_pair);
+STATIC_ASSERT((N_SIZE % 2 == 0), int8_columns_must_pair);
+#endif
 
 // Data width must be positive
 STATIC_ASSERT((DATA_WIDTH > 0), data_width_invalid);
@@ -237,4 +568,15 @@ STATIC_ASSERT((DATA_WIDTH > 0), data_width_invalid);
 // M_SIZE must fit in 5 bits for addressing
 STATIC_ASSERT((M_SIZE <= 32), m_size_too_large);
 
+// Packed stream beats must be a supported AXI width holding whole lanes
+STATIC_ASSERT((AXIS_WIDTH == 64 || AXIS_WIDTH == 128 ||
+               AXIS_WIDTH == 256 || AXIS_WIDTH == 512), axis_width_invalid);
+STATIC_ASSERT((AXIS_WIDTH % DATA_WIDTH == 0), axis_width_not_lane_multiple);
+
+// FC streaming addresses PE groups with the 5-bit weight_load_col
+STATIC_ASSERT((FC_BEATS_PER_INPUT <= 32), fc_beats_per_input_too_large);
+
+// FC batch images are indexed with 3 bits
+STATIC_ASSERT((FC_BATCH_MAX >= 1 && FC_BATCH_MAX <= 8), fc_batch_max_invalid);
+
 #endif // CNN_TYPES_H
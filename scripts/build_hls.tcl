@@ -6,6 +6,10 @@
 
 # Project settings
 set project_name "cnn_inference_engine"
+
+# Top-level variant:
+#   cnn_inference_engine     - host pushes data through AXI4-Stream ports
+#   cnn_inference_engine_ddr - engine fetches/writes DDR itself via m_axi bursts
 set top_function "cnn_inference_engine"
 set solution_name "solution1"
 
@@ -15,6 +19,18 @@ set part "xczu1cg-sbva484-1-e"
 # Clock period: 5ns = 200 MHz (conservative for ZCU102)
 set clock_period 5
 
+# Packed AXI4-Stream beat width for input/weight/output streams (64/128/256/512)
+set axis_width 128
+
+# INT8 mode: 8-bit data, two MACs per DSP48E2 (8x24 PE array)
+set int8 0
+
+# Compiler flags shared by all design sources
+set cflags "-I./include -std=c++11 -DAXIS_WIDTH=$axis_width"
+if {$int8} {
+    append cflags " -DCNN_INT8"
+}
+
 ################################################################################
 # Create Project
 ################################################################################
@@ -29,16 +45,19 @@ open_project $project_name
 set_top $top_function
 
 # Add source files
-add_files src/cnn_inference_engine.cpp -cflags "-I./include -std=c++11"
-add_files src/iec_controller.cpp -cflags "-I./include -std=c++11"
-add_files src/pe_array.cpp -cflags "-I./include -std=c++11"
-add_files src/kpc_controller.cpp -cflags "-I./include -std=c++11"
-add_files src/pe_unit.cpp -cflags "-I./include -std=c++11"
-add_files src/line_memory.cpp -cflags "-I./include -std=c++11"
-add_files src/classify_unit.cpp -cflags "-I./include -std=c++11"
+add_files src/cnn_inference_engine.cpp -cflags $cflags
+add_files src/iec_controller.cpp -cflags $cflags
+add_files src/pe_array.cpp -cflags $cflags
+add_files src/kpc_controller.cpp -cflags $cflags
+add_files src/pe_unit.cpp -cflags $cflags
+add_files src/line_memory.cpp -cflags $cflags
+add_files src/classify_unit.cpp -cflags $cflags
+add_files src/dma_engine.cpp -cflags $cflags
+add_files src/activation_buffer.cpp -cflags $cflags
+add_files src/pool_unit.cpp -cflags $cflags
 
 # Add testbench
-add_files -tb test/testbench.cpp -cflags "-I./include -I./src -std=c++11"
+add_files -tb test/testbench.cpp -cflags "$cflags -I./src"
 
 ################################################################################
 # Create Solution
@@ -136,6 +155,7 @@ puts "Solution: $solution_name"
 puts "Top Function: $top_function"
 puts "Target Device: $part"
 puts "Clock Period: ${clock_period}ns (200 MHz)"
+puts "AXIS Width: ${axis_width} bits"
 puts ""
 puts "Outputs:"
 puts "  - Synthesis report: $project_name/$solution_name/syn/report/"
@@ -0,0 +1,1214 @@
+/******************************************************************************
+ * @file perf_sim.cpp
+ * @brief Host-side cycle-level performance simulator
+ * @description Steps the IEC, KPC, PE-array and CU state machines once per
+ *              clock for a LayerConfig network and reports predicted cycles,
+ *              stream beats and PE utilisation without running Vitis HLS
+ ******************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../include/cnn_types.h"
+
+/******************************************************************************
+ * SIMULATION PARAMETERS
+ ******************************************************************************/
+
+#define SIM_CLOCK_MHZ 200           // Fabric clock (build_hls.tcl: 5 ns period)
+#define SIM_WEIGHT_FIFO_DEPTH 16    // Weight beats buffered ahead of the KPC
+#define SIM_DDR_LATENCY 0           // Default cycles before a burst's first beat
+
+#define SIM_IEC_STATES 8
+#define SIM_KPC_STATES 8
+#define SIM_CU_STATES 3
+
+static const char *iec_state_names[SIM_IEC_STATES] = {
+    "IDLE", "CONFIG", "PREFETCH", "COMPUTE", "NEXT_ITER", "NEXT_LAYER", "CLASSIFY", "DONE"
+};
+
+static const char *kpc_state_names[SIM_KPC_STATES] = {
+    "IDLE", "PREFETCH", "COMPUTE", "STRIDE_H", "STRIDE_V", "DONE", "LOAD_W", "LOAD_B"
+};
+
+static const char *cu_state_names[SIM_CU_STATES] = {
+    "IDLE", "ACTIVE", "DONE"
+};
+
+static const char *layer_type_names[] = {
+    "CONV", "FC", "MAXPOOL", "AVGPOOL", "RELU", "RELU6", "DWCONV", "GAVGPOOL", "ELTWISE"
+};
+
+static long long ceil_div(long long a, long long b) {
+    return (a + b - 1) / b;
+}
+
+/******************************************************************************
+ * LAYER GEOMETRY
+ * Plain-integer copy of a LayerConfig plus the mode and burst geometry the
+ * KPC and IEC derive from it, so the per-cycle loop never touches ap_ types
+ ******************************************************************************/
+
+struct SimLayer {
+    layer_type_t type;
+    int kernel_h, kernel_w, kernel_d;
+    int input_h, input_w, input_c;
+    int output_h, output_w, output_c;
+    int stride, padding, groups;
+    int nl, rl;
+    bool is_fc_last;
+    int num_classes;
+    
+    // Execution mode, as selected by the KPC
+    bool pointwise;
+    bool weight_stationary;
+    bool channel_wise;
+    bool weightless;
+    bool fc_stream;
+    bool beat_stream;
+    const char *mode;
+    
+    // Line-memory fit, as the IEC and KPC check it (see cnn_types.h)
+    bool row_overflow;          // Channel-wise rows exceed LINE_MEM_WIDTH
+    bool unsupported;           // LAYER_UNSUPPORTED: the IEC stops here
+    
+    // PE work per output: weights held per PE (capped by the weight memory)
+    // and the MAC cycles of one window
+    long long filter_size;
+    int weights_per_filter;
+    int window_macs;
+    bool continuous;            // PEs restart without a reset cycle
+    
+    // Window walk in padded rows/columns (KPC_STRIDE_H / KPC_STRIDE_V)
+    int col_end, col_step;
+    int row_end, row_step;
+    
+    long long fc_inputs;        // FC: input elements per neuron
+    long long fc_neurons;       // FC: output_h × output_w × output_c
+    long long stream_total;     // Beat-streaming layers: beats per pass
+    long long total_pixels;     // Pointwise: pixels per pass
+    
+    // Stream traffic (IEC burst geometry)
+    long long beats_per_iteration;
+    long long weight_group_beats;
+    long long out_beats;
+    
+    // PE operations the layer needs per image (utilisation numerator)
+    long long useful_macs;
+};
+
+void sim_layer_setup(const LayerConfig &cfg, SimLayer &layer) {
+    layer.type = cfg.layer_type;
+    layer.kernel_h = cfg.kernel_h;
+    layer.kernel_w = cfg.kernel_w;
+    layer.kernel_d = cfg.kernel_d;
+    layer.input_h = cfg.input_h;
+    layer.input_w = cfg.input_w;
+    layer.input_c = cfg.input_c;
+    layer.output_h = cfg.output_h;
+    layer.output_w = cfg.output_w;
+    layer.output_c = cfg.output_c;
+    layer.stride = (cfg.stride == 0) ? 1 : (int)cfg.stride;
+    layer.padding = cfg.padding;
+    layer.groups = (cfg.groups == 0) ? 1 : (int)cfg.groups;
+    layer.nl = (cfg.nl == 0) ? 1 : (int)cfg.nl;
+    layer.rl = cfg.rl;
+    layer.is_fc_last = cfg.is_fc_last;
+    layer.num_classes = cfg.num_classes;
+    
+    layer.pointwise = IS_POINTWISE(cfg);
+    layer.weight_stationary = IS_WEIGHT_STATIONARY(cfg);
+    layer.channel_wise = IS_CHANNEL_WISE(cfg);
+    layer.weightless = IS_WEIGHTLESS(cfg);
+    layer.fc_stream = (cfg.layer_type == FC);
+    layer.beat_stream = (cfg.layer_type == GAVGPOOL || cfg.layer_type == ELTWISE_ADD);
+    
+    layer.row_overflow = layer.channel_wise && !CW_ROWS_FIT(cfg);
+    layer.unsupported = LAYER_UNSUPPORTED(cfg);
+    
+    bool sparse = (cfg.weight_entries != 0);
+    
+    if (layer.fc_stream) {
+        layer.mode = "FC";
+    } else if (layer.beat_stream) {
+        layer.mode = "STREAM";
+    } else if (layer.channel_wise) {
+        layer.mode = (cfg.layer_type == DWCONV) ? "DW" : "POOL";
+    } else if (layer.pointwise) {
+        layer.mode = "PW";
+    } else if (layer.weight_stationary) {
+        layer.mode = "WS";
+    } else {
+        layer.mode = sparse ? "OS/SP" : "OS";
+    }
+    
+    // Filter size as in KPCController::configure. Filters beyond the weight
+    // memory are rejected by the IEC; they are timed as if they fitted
+    layer.filter_size = (long long)PE_FILTER_SIZE(cfg);
+    layer.weights_per_filter = (int)layer.filter_size;
+    
+    // A MAC output retires after every stored weight, a pooling output after
+    // the whole window; pointwise and depthwise PEs restart back to back
+    if (layer.weightless) {
+        layer.window_macs = layer.kernel_h * layer.kernel_w;
+    } else {
+        layer.window_macs = layer.weights_per_filter;
+    }
+    layer.continuous = layer.pointwise || layer.channel_wise;
+    
+    // Vertical steps: depthwise bands and weight-stationary row groups
+    // cover several output rows
+    int dw_rows = (layer.kernel_h <= M_SIZE) ? (M_SIZE - layer.kernel_h) / layer.stride + 1 : 1;
+    int ws_rows = layer.weight_stationary ? M_SIZE / layer.kernel_h : 1;
+    
+    layer.col_end = layer.input_w + 2 * layer.padding - layer.kernel_w + 1;
+    layer.row_end = layer.input_h + 2 * layer.padding - layer.kernel_h + 1;
+    if (layer.channel_wise) {
+        layer.col_step = layer.stride;
+        layer.row_step = dw_rows * layer.stride;
+    } else if (layer.weight_stationary) {
+        layer.col_step = layer.stride;
+        layer.row_step = ws_rows * layer.stride;
+    } else {
+        layer.col_step = layer.stride;
+        layer.row_step = layer.stride;
+    }
+    
+    layer.fc_inputs = (long long)layer.input_h * layer.input_w * layer.input_c;
+    layer.fc_neurons = (long long)layer.output_h * layer.output_w * layer.output_c;
+    layer.total_pixels = (long long)layer.input_h * layer.input_w;
+    
+    // Input beats per iteration, as in the IEC_CONFIG burst geometry
+    long long row_beats = ceil_div(layer.input_w, AXIS_LANES);
+    
+    layer.stream_total = (long long)layer.input_h * layer.input_c * row_beats / layer.nl;
+    
+    if (layer.channel_wise) {
+        layer.beats_per_iteration = layer.input_h *
+                                    ceil_div((long long)layer.input_w * N_SIZE, AXIS_LANES);
+    } else if (layer.fc_stream) {
+        layer.beats_per_iteration = (long long)layer.input_h * layer.input_c * row_beats;
+    } else if (layer.pointwise) {
+        layer.beats_per_iteration = layer.total_pixels * ceil_div(layer.kernel_d, AXIS_LANES);
+    } else if (layer.groups > 1) {
+        layer.beats_per_iteration = layer.input_h * row_beats * (layer.input_c / layer.groups);
+    } else {
+        layer.beats_per_iteration = layer.stream_total;
+    }
+    
+    // Weight beats per filter group (FC: per neuron group and batch chunk)
+    long long filter_beats = ceil_div(layer.weights_per_filter, AXIS_LANES);
+    
+    if (layer.weightless) {
+        layer.weight_group_beats = 0;
+    } else if (layer.fc_stream) {
+        layer.weight_group_beats = (layer.fc_inputs + 1) * FC_BEATS_PER_INPUT;
+    } else if (layer.weight_stationary) {
+        layer.weight_group_beats = (long long)N_SIZE * layer.kernel_h * filter_beats;
+    } else {
+        layer.weight_group_beats = N_SIZE * filter_beats * (sparse ? 2 : 1);
+    }
+    
+    // Output beats: rows start on beat boundaries; pointwise maps hold one
+    // N_SIZE filter vector per pixel and group, depthwise maps rows of
+    // N_SIZE interleaved channels per group
+    if (layer.pointwise) {
+        layer.out_beats = layer.total_pixels * layer.nl * ceil_div(N_SIZE, AXIS_LANES);
+    } else if (layer.channel_wise) {
+        layer.out_beats = (long long)layer.output_h * layer.nl *
+                          ceil_div((long long)layer.output_w * N_SIZE, AXIS_LANES);
+    } else {
+        layer.out_beats = (long long)layer.output_h * layer.output_c *
+                          ceil_div(layer.output_w, AXIS_LANES);
+    }
+    
+    // Useful work: convolutions count their (pre-pool) output positions
+    // against the weights the PEs actually hold (a weight-stationary filter
+    // spans kernel_h PEs)
+    long long conv_h = (layer.input_h + 2 * layer.padding - layer.kernel_h) / layer.stride + 1;
+    long long conv_w = (layer.input_w + 2 * layer.padding - layer.kernel_w) / layer.stride + 1;
+    long long window = (long long)layer.kernel_h * layer.kernel_w;
+    
+    switch (layer.type) {
+        case CONV:
+            layer.useful_macs = conv_h * conv_w * layer.output_c * layer.weights_per_filter *
+                                (layer.weight_stationary ? layer.kernel_h : 1);
+            break;
+        case DWCONV:
+        case MAXPOOL:
+        case AVGPOOL:
+            layer.useful_macs = conv_h * conv_w * layer.output_c * window;
+            break;
+        case FC:
+            layer.useful_macs = layer.fc_inputs * layer.fc_neurons;
+            break;
+        default:
+            layer.useful_macs = layer.total_pixels * layer.input_c;
+            break;
+    }
+}
+
+/******************************************************************************
+ * STATISTICS
+ ******************************************************************************/
+
+struct LayerStats {
+    long long cycles;
+    long long iec_cycles[SIM_IEC_STATES];
+    long long kpc_cycles[SIM_KPC_STATES];
+    long long cu_cycles[SIM_CU_STATES];
+    long long mac_cycles;       // Cycles the PE array spent on MAC/pool work
+    long long input_stall;      // Cycles the KPC waited for input beats
+    long long weight_stall;     // Cycles the KPC waited for weight beats
+    long long input_beats;
+    long long weight_beats;
+    long long bias_words;
+    long long output_beats;
+    bool input_on_chip;
+    bool output_on_chip;
+};
+
+/******************************************************************************
+ * DMA CHANNEL MODEL
+ * One burst outstanding at a time, up to DMA_MAX_BURST beats, one beat per
+ * cycle after the DDR latency (IECController::request_bursts). Beats held in
+ * the on-chip activation buffer arrive one per cycle without bursts
+ ******************************************************************************/
+
+class SimDMA {
+private:
+    long long total;            // Beats of the current job
+    long long issued;           // Beats requested so far
+    long long delivered;        // Beats delivered so far
+    long long limit;            // Backpressure: delivery stops at this beat
+    long long burst_left;       // Beats of the outstanding burst
+    int latency_left;           // Cycles until the burst's first beat
+    int latency;
+    bool on_chip;
+
+public:
+    SimDMA() : total(0), issued(0), delivered(0), limit(0),
+               burst_left(0), latency_left(0), latency(0), on_chip(false) {}
+    
+    void start(long long beats, bool from_chip, int ddr_latency) {
+        total = beats;
+        issued = 0;
+        delivered = 0;
+        limit = beats;
+        burst_left = 0;
+        latency_left = 0;
+        latency = ddr_latency;
+        on_chip = from_chip;
+    }
+    
+    void set_limit(long long beats) {
+        limit = beats;
+    }
+    
+    long long get_delivered() const {
+        return delivered;
+    }
+    
+    // Advance one cycle
+    void step() {
+        if (on_chip) {
+            if (delivered < total && delivered < limit) {
+                delivered++;
+            }
+        } else if (burst_left > 0) {
+            if (latency_left > 0) {
+                latency_left--;
+            } else if (delivered < limit) {
+                delivered++;
+                burst_left--;
+            }
+        } else if (issued < total && issued < limit) {
+            // Issue cycle of the next burst
+            long long remaining = total - issued;
+            burst_left = (remaining < DMA_MAX_BURST) ? remaining : (long long)DMA_MAX_BURST;
+            issued += burst_left;
+            latency_left = latency;
+        }
+    }
+};
+
+/******************************************************************************
+ * PE ARRAY MODEL
+ * All enabled PEs advance in lockstep: a restart cycle reloads the bias,
+ * then one weight per cycle until the output retires (PE::issue/retire)
+ ******************************************************************************/
+
+class SimPEArray {
+private:
+    int weight_addr;            // Weights applied to the current output
+    bool restart;               // Reset cycle pending
+
+public:
+    SimPEArray() : weight_addr(0), restart(false) {}
+    
+    void start_pass() {
+        weight_addr = 0;
+        restart = true;
+    }
+    
+    // No weight of the next outputs applied yet (and no reset pending)
+    bool output_start() const {
+        return weight_addr == 0 && !restart;
+    }
+    
+    // One enabled cycle; returns true when the outputs complete
+    bool step(const SimLayer &layer, LayerStats &stats) {
+        bool valid = false;
+        
+        if (restart) {
+            restart = false;
+        } else {
+            stats.mac_cycles++;
+            weight_addr++;
+            
+            if (weight_addr >= layer.window_macs) {
+                weight_addr = 0;
+                restart = !layer.continuous;
+                valid = true;
+            }
+        }
+        return valid;
+    }
+};
+
+/******************************************************************************
+ * KPC MODEL (KPCController state machine)
+ ******************************************************************************/
+
+class SimKPC {
+private:
+    kpc_state_t current_state;
+    
+    int current_row;
+    int current_col;
+    int iteration_count;
+    int data_fetched;
+    
+    // Ping-pong weight banks: beats of the group being loaded
+    bool loading;
+    bool bank_ready;
+    int groups_loaded;
+    long long load_beats;
+    
+    int bias_idx;
+    long long pixels_done;
+    long long fc_k;
+    int fc_beat;
+    int fc_image;               // FC: image of the chunk the held beat is on
+    long long fc_replay;        // FC: cycles left completing later images
+    long long fc_outputs;       // FC neurons finished this layer
+    long long stream_beats;
+    
+    int batch_size;
+    int image_count;
+    long long pass;             // (filter group, image) passes finished
+    
+    // Images of the current pass: an FC pass takes a chunk of up to
+    // FC_BATCH_MAX images, every other pass one
+    int pass_images(const SimLayer &layer) const {
+        if (!layer.fc_stream) {
+            return 1;
+        }
+        int left = batch_size - image_count;
+        return (left < FC_BATCH_MAX) ? left : FC_BATCH_MAX;
+    }
+    bool pass_end;              // Pass complete, waiting for its last input
+    
+    SimPEArray pe;
+    
+    // Input beats of the pass a depthwise band reads: the stored rows up to
+    // its last window's bottom row
+    long long band_beats(const SimLayer &layer) const {
+        long long rows = current_row - layer.padding + layer.row_step - layer.stride +
+                         layer.kernel_h;
+        if (rows > layer.input_h) {
+            rows = layer.input_h;
+        }
+        return rows * (layer.beats_per_iteration / layer.input_h);
+    }
+    
+    void swap_weight_banks(const SimLayer &layer) {
+        bank_ready = false;
+        if (groups_loaded < layer.nl) {
+            load_beats = 0;
+            loading = true;
+            groups_loaded++;
+        }
+    }
+    
+    void finish_iteration(const SimLayer &layer) {
+        pass += pass_images(layer);
+        image_count += layer.fc_stream ? FC_BATCH_MAX : 1;
+        
+        if (image_count < batch_size) {
+            data_fetched = 0;
+            current_state = (layer.fc_stream || layer.beat_stream) ? KPC_COMPUTE : KPC_PREFETCH;
+        } else {
+            image_count = 0;
+            iteration_count++;
+            
+            if (iteration_count >= layer.nl) {
+                current_state = KPC_DONE;
+            } else if (layer.fc_stream || layer.beat_stream) {
+                current_state = KPC_COMPUTE;
+            } else if (layer.weightless) {
+                data_fetched = 0;
+                current_state = KPC_PREFETCH;
+            } else {
+                data_fetched = 0;
+                if (bank_ready) {
+                    swap_weight_banks(layer);
+                    bias_idx = 0;
+                    current_state = KPC_LOAD_BIAS;
+                } else {
+                    current_state = KPC_LOAD_WEIGHTS;
+                }
+            }
+        }
+    }
+
+public:
+    SimKPC() : current_state(KPC_IDLE), current_row(0), current_col(0),
+               iteration_count(0), data_fetched(0), loading(false), bank_ready(false),
+               groups_loaded(0), load_beats(0), bias_idx(0), pixels_done(0), fc_k(0),
+               fc_beat(0), fc_image(0), fc_replay(0), fc_outputs(0), stream_beats(0), batch_size(1), image_count(0),
+               pass(0), pass_end(false) {}
+    
+    kpc_state_t state() const {
+        return current_state;
+    }
+    
+    long long passes_done() const {
+        return pass;
+    }
+    
+    // Between layers: nothing runs until the next configure
+    void idle() {
+        current_state = KPC_IDLE;
+        pass = 0;
+        pass_end = false;
+    }
+    
+    void configure(const SimLayer &layer, int batch) {
+        current_row = 0;
+        current_col = 0;
+        iteration_count = 0;
+        data_fetched = 0;
+        bias_idx = 0;
+        pixels_done = 0;
+        fc_k = 0;
+        fc_beat = 0;
+        fc_image = 0;
+        fc_replay = 0;
+        fc_outputs = 0;
+        stream_beats = 0;
+        batch_size = (batch == 0) ? 1 : batch;
+        image_count = 0;
+        pass = 0;
+        pass_end = false;
+        
+        // First filter group loads before anything else
+        load_beats = 0;
+        loading = true;
+        bank_ready = false;
+        groups_loaded = 1;
+        current_state = KPC_LOAD_WEIGHTS;
+        
+        if (layer.fc_stream) {
+            loading = false;
+            current_state = KPC_COMPUTE;
+        }
+        if (layer.weightless) {
+            loading = false;
+            current_state = layer.beat_stream ? KPC_COMPUTE : KPC_PREFETCH;
+        }
+    }
+    
+    // Advance one cycle. input_ready: beats delivered for this layer so
+    // far; weight_ready: a weight beat is waiting. Returns the FC neurons
+    // completed this cycle (classification input)
+    long long step(
+        const SimLayer &layer,
+        long long input_ready,
+        bool weight_ready,
+        bool &weight_ack,
+        LayerStats &stats
+    ) {
+        long long new_outputs = 0;
+        weight_ack = false;
+        
+        stats.kpc_cycles[current_state]++;
+        
+        // Background weight load into the idle bank, one beat per cycle
+        if (loading) {
+            if (weight_ready) {
+                weight_ack = true;
+                load_beats++;
+                if (load_beats == layer.weight_group_beats) {
+                    loading = false;
+                    bank_ready = true;
+                }
+            } else if (current_state == KPC_LOAD_WEIGHTS) {
+                stats.weight_stall++;
+            }
+        }
+        
+        // The later images of an FC chunk complete from the kept bias row:
+        // one pass-boundary cycle and FC_BEATS_PER_INPUT beats each
+        if (fc_replay > 0) {
+            fc_replay--;
+            stats.mac_cycles++;
+            return new_outputs;
+        }
+        
+        // A finished pass hands over once its input has fully arrived
+        // (the line memories must have received every row)
+        if (pass_end) {
+            if (input_ready >= (pass + pass_images(layer)) * layer.beats_per_iteration) {
+                pass_end = false;
+                finish_iteration(layer);
+            } else {
+                stats.input_stall++;
+            }
+            return new_outputs;
+        }
+        
+        switch (current_state) {
+            
+            case KPC_IDLE:
+            case KPC_DONE:
+                break;
+            
+            case KPC_LOAD_WEIGHTS:
+                if (bank_ready) {
+                    swap_weight_banks(layer);
+                    bias_idx = 0;
+                    current_state = KPC_LOAD_BIAS;
+                }
+                break;
+            
+            case KPC_LOAD_BIAS:
+                // One bias per filter column
+                stats.bias_words++;
+                bias_idx++;
+                if (bias_idx == N_SIZE) {
+                    bias_idx = 0;
+                    current_state = KPC_PREFETCH;
+                }
+                break;
+            
+            case KPC_PREFETCH: {
+                // rl cycles, and the first rl elements of the pass present
+                long long needed = ceil_div(layer.rl, AXIS_LANES);
+                if (needed > layer.beats_per_iteration) {
+                    needed = layer.beats_per_iteration;
+                }
+                
+                data_fetched++;
+                if (data_fetched >= layer.rl) {
+                    if (input_ready >= pass * layer.beats_per_iteration + needed) {
+                        pe.start_pass();
+                        current_state = KPC_COMPUTE;
+                    } else {
+                        stats.input_stall++;
+                    }
+                }
+                break;
+            }
+            
+            case KPC_COMPUTE:
+                if (layer.fc_stream) {
+                    // One weight beat per cycle and chunk image straight
+                    // into the MACs; the bias row completes TOTAL_PES
+                    // neurons of image 0, the rest follow from the kept row
+                    if (weight_ready) {
+                        stats.mac_cycles++;
+                        fc_image++;
+                        if (fc_k == layer.fc_inputs || fc_image == pass_images(layer)) {
+                            fc_image = 0;
+                            weight_ack = true;
+                            fc_beat++;
+                        }
+                        if (weight_ack && fc_beat == FC_BEATS_PER_INPUT) {
+                            fc_beat = 0;
+                            fc_k++;
+                            
+                            if (fc_k > layer.fc_inputs) {
+                                fc_k = 0;
+                                
+                                // Neurons of this group (batch images repeat it)
+                                long long remaining = layer.fc_neurons - fc_outputs;
+                                new_outputs = (remaining < TOTAL_PES) ? remaining : (long long)TOTAL_PES;
+                                if (image_count + pass_images(layer) == batch_size) {
+                                    fc_outputs += new_outputs;
+                                }
+                                fc_replay = (long long)(pass_images(layer) - 1) *
+                                            (FC_BEATS_PER_INPUT + 1);
+                                pass_end = true;
+                            }
+                        }
+                    } else {
+                        stats.weight_stall++;
+                    }
+                } else if (layer.beat_stream) {
+                    // One input beat per cycle as it arrives
+                    if (input_ready > pass * layer.beats_per_iteration + stream_beats) {
+                        stats.mac_cycles++;
+                        stream_beats++;
+                        if (stream_beats == layer.stream_total) {
+                            stream_beats = 0;
+                            pass_end = true;
+                        }
+                    } else {
+                        stats.input_stall++;
+                    }
+                } else if (layer.pointwise) {
+                    // M_SIZE pixels per block, no window or stride states; a
+                    // block starts once all of its pixels have arrived
+                    long long block_end = pixels_done + M_SIZE;
+                    if (block_end > layer.total_pixels) {
+                        block_end = layer.total_pixels;
+                    }
+                    long long needed = pass * layer.beats_per_iteration +
+                                       block_end * ceil_div(layer.kernel_d, AXIS_LANES);
+                    
+                    if (pe.output_start() && input_ready < needed) {
+                        stats.input_stall++;
+                    } else if (pe.step(layer, stats)) {
+                        pixels_done += M_SIZE;
+                        if (pixels_done >= layer.total_pixels) {
+                            pixels_done = 0;
+                            pass_end = true;
+                        }
+                    }
+                } else if (layer.channel_wise && current_col == 0 && pe.output_start() &&
+                           input_ready < pass * layer.beats_per_iteration + band_beats(layer)) {
+                    // A depthwise band starts once the rows it reads arrived
+                    stats.input_stall++;
+                } else if (pe.step(layer, stats)) {
+                    // Window complete
+                    current_state = KPC_STRIDE_H;
+                }
+                break;
+            
+            case KPC_STRIDE_H:
+                current_col += layer.col_step;
+                if (current_col >= layer.col_end) {
+                    current_col = 0;
+                    current_state = KPC_STRIDE_V;
+                } else {
+                    current_state = KPC_COMPUTE;
+                }
+                break;
+            
+            case KPC_STRIDE_V:
+                current_row += layer.row_step;
+                if (current_row >= layer.row_end) {
+                    current_row = 0;
+                    pass_end = true;
+                } else {
+                    current_state = KPC_COMPUTE;
+                }
+                break;
+        }
+        
+        return new_outputs;
+    }
+};
+
+/******************************************************************************
+ * CU MODEL (classify_unit CUC state machine)
+ ******************************************************************************/
+
+class SimCU {
+private:
+    cuc_state_t state;
+    long long pending;          // FClast activations waiting in the stream
+    int class_counter;
+
+public:
+    SimCU() : state(CUC_IDLE), pending(0), class_counter(0) {}
+    
+    void reset() {
+        state = CUC_IDLE;
+        pending = 0;
+        class_counter = 0;
+    }
+    
+    void push(long long activations) {
+        pending += activations;
+    }
+    
+    bool done() const {
+        return state == CUC_DONE;
+    }
+    
+    // One activation per cycle through the CNG/ACSU
+    void step(const SimLayer &layer, LayerStats &stats) {
+        stats.cu_cycles[state]++;
+        
+        switch (state) {
+            case CUC_IDLE:
+                if (layer.is_fc_last && pending > 0) {
+                    class_counter = 0;
+                    state = CUC_ACTIVE;
+                }
+                break;
+            
+            case CUC_ACTIVE:
+                if (pending > 0) {
+                    pending--;
+                    class_counter++;
+                    if (class_counter >= layer.num_classes) {
+                        state = CUC_DONE;
+                    }
+                }
+                break;
+            
+            case CUC_DONE:
+                break;
+        }
+    }
+};
+
+/******************************************************************************
+ * IEC MODEL (IECController state machine) AND SIMULATION LOOP
+ ******************************************************************************/
+
+struct SimOptions {
+    int batch;
+    int ddr_latency;
+    bool show_states;
+};
+
+// Steps the whole engine until IEC_DONE; returns the total cycle count
+long long simulate(LayerConfig layers[], int num_layers, const SimOptions &opt,
+                   SimLayer geometry[], LayerStats stats[]) {
+    SimKPC kpc;
+    SimCU cu;
+    SimDMA input_dma;
+    SimDMA weight_dma;
+    
+    iec_state_t iec_state = IEC_IDLE;
+    int layer_idx = 0;
+    bool prev_dst_on_chip = false;
+    long long weight_consumed = 0;
+    long long cycle = 0;
+    
+    memset(stats, 0, sizeof(LayerStats) * num_layers);
+    for (int l = 0; l < num_layers; l++) {
+        sim_layer_setup(layers[l], geometry[l]);
+    }
+    
+    while (iec_state != IEC_DONE) {
+        SimLayer &layer = geometry[layer_idx];
+        LayerStats &ls = stats[layer_idx];
+        
+        ls.cycles++;
+        ls.iec_cycles[iec_state]++;
+        
+        // Streams: the input fetch runs at most one pass (FC: chunk) ahead
+        // of the KPU, the weight stream SIM_WEIGHT_FIFO_DEPTH beats ahead
+        long long ahead = layer.fc_stream ? 2 * FC_BATCH_MAX : 2;
+        input_dma.set_limit((kpc.passes_done() + ahead) * layer.beats_per_iteration);
+        weight_dma.set_limit(weight_consumed + SIM_WEIGHT_FIFO_DEPTH);
+        input_dma.step();
+        weight_dma.step();
+        
+        // KPU and CU run while the IEC is in compute (and while classifying)
+        if (iec_state == IEC_COMPUTE || iec_state == IEC_NEXT_ITER || iec_state == IEC_CLASSIFY) {
+            bool weight_ack;
+            long long new_outputs = kpc.step(layer, input_dma.get_delivered(),
+                                             weight_dma.get_delivered() > weight_consumed,
+                                             weight_ack, ls);
+            if (weight_ack) {
+                weight_consumed++;
+            }
+            if (layer.is_fc_last) {
+                cu.push(new_outputs);
+            }
+            cu.step(layer, ls);
+        }
+        
+        switch (iec_state) {
+            case IEC_IDLE:
+                iec_state = IEC_CONFIG;
+                break;
+            
+            case IEC_CONFIG: {
+                // Activation routing as in IEC_CONFIG: intermediate maps stay
+                // on chip when they fit, a batch keeps its images in DDR
+                bool last_layer = (layer_idx == num_layers - 1) || layer.is_fc_last;
+                const SimLayer &next = geometry[last_layer ? layer_idx : layer_idx + 1];
+                bool next_rereads = (next.groups > 1) && (next.nl > next.groups);
+                
+                ls.input_on_chip = prev_dst_on_chip;
+                ls.output_on_chip = !last_layer && (opt.batch == 1) && !next_rereads &&
+                                    (layer.out_beats <= ACT_BUF_DEPTH);
+                prev_dst_on_chip = ls.output_on_chip;
+                
+                // FC neuron groups stream once per chunk of FC_BATCH_MAX images
+                long long passes = (long long)layer.nl * opt.batch;
+                long long weight_groups = layer.fc_stream ?
+                                          layer.nl * ceil_div(opt.batch, FC_BATCH_MAX) :
+                                          (long long)layer.nl;
+                
+                ls.input_beats = passes * layer.beats_per_iteration;
+                ls.weight_beats = weight_groups * layer.weight_group_beats;
+                ls.output_beats = layer.out_beats * opt.batch;
+                
+                input_dma.start(ls.input_beats, ls.input_on_chip, opt.ddr_latency);
+                weight_dma.start(ls.weight_beats, false, opt.ddr_latency);
+                weight_consumed = 0;
+                kpc.idle();
+                cu.reset();
+                
+                iec_state = IEC_PREFETCH;
+                break;
+            }
+            
+            case IEC_PREFETCH:
+                // Start the KPU once rl elements have arrived
+                if (input_dma.get_delivered() * AXIS_LANES >= layer.rl ||
+                    input_dma.get_delivered() == ls.input_beats) {
+                    kpc.configure(layer, opt.batch);
+                    iec_state = IEC_COMPUTE;
+                }
+                break;
+            
+            case IEC_COMPUTE:
+                if (kpc.state() == KPC_DONE) {
+                    iec_state = IEC_NEXT_ITER;
+                }
+                break;
+            
+            case IEC_NEXT_ITER:
+                iec_state = layer.is_fc_last ? IEC_CLASSIFY : IEC_NEXT_LAYER;
+                break;
+            
+            case IEC_CLASSIFY:
+                if (cu.done()) {
+                    iec_state = IEC_NEXT_LAYER;
+                }
+                break;
+            
+            case IEC_NEXT_LAYER:
+                if (layer_idx + 1 >= num_layers || layer.is_fc_last) {
+                    iec_state = IEC_DONE;
+                } else {
+                    layer_idx++;
+                    iec_state = IEC_CONFIG;
+                }
+                break;
+            
+            case IEC_DONE:
+                break;
+        }
+        
+        cycle++;
+    }
+    
+    return cycle;
+}
+
+/******************************************************************************
+ * NETWORK BUILDERS
+ ******************************************************************************/
+
+// CONV layer with optional fused ReLU + max-pool (pool = 1: none)
+LayerConfig conv_layer(int in_h, int in_w, int in_c, int filters,
+                       int kernel, int stride, int padding, int pool) {
+    LayerConfig cfg;
+    cfg.layer_type = CONV;
+    cfg.kernel_h = kernel;
+    cfg.kernel_w = kernel;
+    cfg.kernel_d = in_c;
+    cfg.num_filters = filters;
+    cfg.input_h = in_h;
+    cfg.input_w = in_w;
+    cfg.input_c = in_c;
+    int conv_h = (in_h + 2 * padding - kernel) / stride + 1;
+    int conv_w = (in_w + 2 * padding - kernel) / stride + 1;
+    cfg.output_h = conv_h / pool;
+    cfg.output_w = conv_w / pool;
+    cfg.output_c = filters;
+    cfg.stride = stride;
+    cfg.padding = padding;
+    cfg.activation = ACT_RELU;
+    cfg.pool_size = pool;
+    cfg.pool_stride = pool;
+    cfg.nl = ceil_div(filters, N_SIZE);
+    int rl = kernel * in_w;
+    cfg.rl = (rl > 1023) ? 1023 : rl;
+    cfg.is_fc_last = false;
+    return cfg;
+}
+
+// Stand-alone max-pool layer
+LayerConfig pool_layer(int in_h, int in_w, int channels, int window, int stride) {
+    LayerConfig cfg;
+    cfg.layer_type = MAXPOOL;
+    cfg.kernel_h = window;
+    cfg.kernel_w = window;
+    cfg.kernel_d = 1;
+    cfg.input_h = in_h;
+    cfg.input_w = in_w;
+    cfg.input_c = channels;
+    cfg.output_h = (in_h - window) / stride + 1;
+    cfg.output_w = (in_w - window) / stride + 1;
+    cfg.output_c = channels;
+    cfg.stride = stride;
+    cfg.padding = 0;
+    cfg.activation = ACT_NONE;
+    cfg.nl = ceil_div(channels, N_SIZE);
+    cfg.rl = window * in_w;
+    cfg.is_fc_last = false;
+    return cfg;
+}
+
+// FC layer over an in_h × in_w × in_c input. Widths beyond the 11-bit
+// channel fields are split into rows (out_h × out_c neurons)
+LayerConfig fc_layer(int in_h, int in_w, int in_c, int out_h, int out_c,
+                     bool last, int classes) {
+    LayerConfig cfg;
+    cfg.layer_type = FC;
+    cfg.kernel_h = 1;
+    cfg.kernel_w = 1;
+    cfg.kernel_d = 1;
+    cfg.input_h = in_h;
+    cfg.input_w = in_w;
+    cfg.input_c = in_c;
+    cfg.output_h = out_h;
+    cfg.output_w = 1;
+    cfg.output_c = out_c;
+    cfg.stride = 1;
+    cfg.padding = 0;
+    cfg.activation = last ? ACT_NONE : ACT_RELU;
+    cfg.nl = ceil_div((long long)out_h * out_c, TOTAL_PES);
+    cfg.rl = (in_c > 1023) ? 1023 : in_c;
+    cfg.is_fc_last = last;
+    cfg.num_classes = classes;
+    return cfg;
+}
+
+// VGG16 with the block max-pools fused into the last CONV of each block;
+// the 4096-wide FC layers run as 4 rows of 1024
+int build_vgg16(LayerConfig layers[]) {
+    int n = 0;
+    layers[n++] = conv_layer(224, 224, 3, 64, 3, 1, 1, 1);
+    layers[n++] = conv_layer(224, 224, 64, 64, 3, 1, 1, 2);
+    layers[n++] = conv_layer(112, 112, 64, 128, 3, 1, 1, 1);
+    layers[n++] = conv_layer(112, 112, 128, 128, 3, 1, 1, 2);
+    layers[n++] = conv_layer(56, 56, 128, 256, 3, 1, 1, 1);
+    layers[n++] = conv_layer(56, 56, 256, 256, 3, 1, 1, 1);
+    layers[n++] = conv_layer(56, 56, 256, 256, 3, 1, 1, 2);
+    layers[n++] = conv_layer(28, 28, 256, 512, 3, 1, 1, 1);
+    layers[n++] = conv_layer(28, 28, 512, 512, 3, 1, 1, 1);
+    layers[n++] = conv_layer(28, 28, 512, 512, 3, 1, 1, 2);
+    layers[n++] = conv_layer(14, 14, 512, 512, 3, 1, 1, 1);
+    layers[n++] = conv_layer(14, 14, 512, 512, 3, 1, 1, 1);
+    layers[n++] = conv_layer(14, 14, 512, 512, 3, 1, 1, 2);
+    layers[n++] = fc_layer(7, 7, 512, 4, 1024, false, 0);
+    layers[n++] = fc_layer(4, 1, 1024, 4, 1024, false, 0);
+    layers[n++] = fc_layer(4, 1, 1024, 1, 1000, true, 1000);
+    return n;
+}
+
+// Small CIFAR-style network for quick checks
+int build_tiny(LayerConfig layers[]) {
+    int n = 0;
+    layers[n++] = conv_layer(32, 32, 3, 16, 3, 1, 1, 1);
+    layers[n++] = pool_layer(32, 32, 16, 2, 2);
+    layers[n++] = conv_layer(16, 16, 16, 32, 3, 1, 1, 2);
+    layers[n++] = fc_layer(8, 8, 32, 1, 10, true, 10);
+    return n;
+}
+
+/******************************************************************************
+ * REPORT
+ ******************************************************************************/
+
+void print_report(const char *network, int num_layers, const SimOptions &opt,
+                  const SimLayer geometry[], const LayerStats stats[],
+                  long long total_cycles, double wall_seconds) {
+    double cycle_ms = 1.0e-3 / SIM_CLOCK_MHZ;
+    
+    printf("Network %s: %d layers, batch %d\n", network, num_layers, opt.batch);
+    printf("PE array %dx%d (%d PEs, %d DSPs), %d-bit streams, %d MHz, DDR latency %d\n\n",
+           M_SIZE, N_SIZE, TOTAL_PES, TOTAL_DSPS, AXIS_WIDTH, SIM_CLOCK_MHZ, opt.ddr_latency);
+    
+    printf("%3s %-8s %-6s %5s %13s %10s %6s %6s %11s %11s %11s\n",
+           "#", "type", "mode", "nl", "cycles", "ms", "mac%", "util%",
+           "in beats", "wt beats", "out beats");
+    
+    long long total_in = 0, total_wt = 0, total_out = 0, total_macs = 0;
+    
+    for (int l = 0; l < num_layers; l++) {
+        const SimLayer &g = geometry[l];
+        const LayerStats &s = stats[l];
+        double busy = (s.cycles == 0) ? 0.0 : 100.0 * (double)s.mac_cycles / s.cycles;
+        double util = (s.cycles == 0) ? 0.0 :
+                      100.0 * (double)g.useful_macs * opt.batch / ((double)TOTAL_PES * s.cycles);
+        
+        printf("%3d %-8s %-6s %5d %13lld %10.3f %6.1f %6.1f %10lld%s %11lld %10lld%s\n",
+               l, layer_type_names[g.type], g.mode, g.nl, s.cycles, s.cycles * cycle_ms,
+               busy, util,
+               s.input_beats, s.input_on_chip ? "*" : " ", s.weight_beats,
+               s.output_beats, s.output_on_chip ? "*" : " ");
+        
+        total_in += s.input_on_chip ? 0 : s.input_beats;
+        total_wt += s.weight_beats;
+        total_out += s.output_on_chip ? 0 : s.output_beats;
+        total_macs += g.useful_macs * opt.batch;
+    }
+    printf("(mac%% = cycles the PE array issued work, util%% = useful PE operations\n"
+           " over all PE-cycles, * = on-chip activation buffer, no DDR traffic)\n\n");
+    
+    if (opt.show_states) {
+        printf("Cycles per KPC state\n%3s", "#");
+        for (int s = 0; s < SIM_KPC_STATES; s++) {
+            printf(" %11s", kpc_state_names[s]);
+        }
+        printf(" %11s %11s\n", "in stall", "wt stall");
+        for (int l = 0; l < num_layers; l++) {
+            printf("%3d", l);
+            for (int s = 0; s < SIM_KPC_STATES; s++) {
+                printf(" %11lld", stats[l].kpc_cycles[s]);
+            }
+            printf(" %11lld %11lld\n", stats[l].input_stall, stats[l].weight_stall);
+        }
+        
+        printf("\nCycles per IEC / CU state\n%3s", "#");
+        for (int s = 0; s < SIM_IEC_STATES; s++) {
+            printf(" %10s", iec_state_names[s]);
+        }
+        for (int s = 0; s < SIM_CU_STATES; s++) {
+            printf(" %7s", cu_state_names[s]);
+        }
+        printf("\n");
+        for (int l = 0; l < num_layers; l++) {
+            printf("%3d", l);
+            for (int s = 0; s < SIM_IEC_STATES; s++) {
+                printf(" %10lld", stats[l].iec_cycles[s]);
+            }
+            for (int s = 0; s < SIM_CU_STATES; s++) {
+                printf(" %7lld", stats[l].cu_cycles[s]);
+            }
+            printf("\n");
+        }
+        printf("\n");
+    }
+    
+    for (int l = 0; l < num_layers; l++) {
+        bool filter_overflow = !geometry[l].weightless && !geometry[l].fc_stream &&
+                               geometry[l].filter_size > WEIGHT_MEM_DEPTH;
+        if (filter_overflow) {
+            printf("warning: layer %d filter (%lld weights) exceeds WEIGHT_MEM_DEPTH = %d; "
+                   "the IEC rejects it, the host must split it into channel slices\n",
+                   l, geometry[l].filter_size, WEIGHT_MEM_DEPTH);
+        }
+        if (geometry[l].row_overflow) {
+            printf("warning: layer %d interleaved rows exceed LINE_MEM_WIDTH = %d; "
+                   "the IEC rejects it, the host must split it into column tiles\n",
+                   l, LINE_MEM_WIDTH);
+        }
+        if (geometry[l].unsupported && !filter_overflow && !geometry[l].row_overflow) {
+            printf("warning: layer %d is rejected by the IEC (LAYER_UNSUPPORTED); "
+                   "the hardware stops before it\n", l);
+        }
+    }
+    
+    double seconds = total_cycles * cycle_ms * 1.0e-3;
+    printf("\nTotal: %lld cycles, %.3f ms per batch, %.1f images/s, PE utilisation %.1f%%\n",
+           total_cycles, seconds * 1.0e3, opt.batch / seconds,
+           100.0 * (double)total_macs / ((double)TOTAL_PES * total_cycles));
+    printf("DDR traffic: %lld input, %lld weight, %lld output beats (%.1f MB)\n",
+           total_in, total_wt, total_out,
+           (double)(total_in + total_wt + total_out) * (AXIS_WIDTH / 8) / (1024.0 * 1024.0));
+    printf("Simulated in %.2f s\n", wall_seconds);
+}
+
+/******************************************************************************
+ * MAIN
+ ******************************************************************************/
+
+static void usage(const char *prog) {
+    printf("Usage: %s [vgg16|tiny] [options]\n", prog);
+    printf("  --batch N          Images per batch (default 1)\n");
+    printf("  --ddr-latency N    Cycles before each burst's first beat (default %d)\n",
+           SIM_DDR_LATENCY);
+    printf("  --ws               Weight-stationary dataflow on every CONV layer\n");
+    printf("  --zero-skip        Zero skip on every CONV layer (no cycle change)\n");
+    printf("  --states           Print per-state cycle tables\n");
+}
+
+int main(int argc, char **argv) {
+    static LayerConfig layers[MAX_LAYERS];
+    static SimLayer geometry[MAX_LAYERS];
+    static LayerStats stats[MAX_LAYERS];
+    
+    const char *network = "vgg16";
+    SimOptions opt;
+    opt.batch = 1;
+    opt.ddr_latency = SIM_DDR_LATENCY;
+    opt.show_states = false;
+    bool weight_stationary = false;
+    bool zero_skip = false;
+    
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--batch") == 0 && a + 1 < argc) {
+            opt.batch = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--ddr-latency") == 0 && a + 1 < argc) {
+            opt.ddr_latency = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--ws") == 0) {
+            weight_stationary = true;
+        } else if (strcmp(argv[a], "--zero-skip") == 0) {
+            zero_skip = true;
+        } else if (strcmp(argv[a], "--states") == 0) {
+            opt.show_states = true;
+        } else if (argv[a][0] != '-') {
+            network = argv[a];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.batch < 1 || opt.batch > 255 || opt.ddr_latency < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    int num_layers;
+    if (strcmp(network, "vgg16") == 0) {
+        num_layers = build_vgg16(layers);
+    } else if (strcmp(network, "tiny") == 0) {
+        num_layers = build_tiny(layers);
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    for (int l = 0; l < num_layers; l++) {
+        if (layers[l].layer_type == CONV) {
+            if (weight_stationary) {
+                layers[l].dataflow = DATAFLOW_WEIGHT_STATIONARY;
+            }
+            layers[l].zero_skip = zero_skip;
+        }
+    }
+    
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    long long total_cycles = simulate(layers, num_layers, opt, geometry, stats);
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    double wall_seconds = std::chrono::duration<double>(t1 - t0).count();
+    
+    print_report(network, num_layers, opt, geometry, stats, total_cycles, wall_seconds);
+    return 0;
+}
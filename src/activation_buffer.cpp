@@ -0,0 +1,127 @@
+/******************************************************************************
+ * @file activation_buffer.cpp
+ * @brief On-chip activation buffer implementation
+ * @description Source bank feeds the line memories while the destination bank collects outputs;
+ *              the skip buffer holds one residual map across layers
+ ******************************************************************************/
+
+#include "activation_buffer.h"
+
+/******************************************************************************
+ * ACTIVATION BUFFER IMPLEMENTATION
+ ******************************************************************************/
+
+ActivationBuffer::ActivationBuffer() {
+    #pragma HLS ARRAY_PARTITION variable=memory complete dim=1
+    #pragma HLS BIND_STORAGE variable=memory type=RAM_2P impl=BRAM
+    #pragma HLS ARRAY_PARTITION variable=fill complete
+    
+    fill[0] = 0;
+    fill[1] = 0;
+    read_bank = 0;
+    write_bank = 1;
+    read_ptr = 0;
+    write_ptr = 0;
+}
+
+void ActivationBuffer::begin_layer(ActivationRoute route) {
+    #pragma HLS INLINE
+    
+    read_bank = route.src_bank;
+    read_ptr = 0;
+    
+    write_bank = route.dst_bank;
+    write_ptr = 0;
+    
+    // The destination bank is overwritten by this layer
+    if (route.dst_on_chip) {
+        fill[route.dst_bank] = 0;
+    }
+}
+
+bool ActivationBuffer::read_beat(axis_beat_t &beat) {
+    #pragma HLS INLINE off
+    #pragma HLS PIPELINE II=1
+    
+    if (read_ptr >= fill[read_bank]) {
+        return false;
+    }
+    
+    beat = memory[read_bank][read_ptr];
+    read_ptr++;
+    return true;
+}
+
+void ActivationBuffer::rewind() {
+    #pragma HLS INLINE
+    
+    read_ptr = 0;
+}
+
+void ActivationBuffer::write_beat(const axis_beat_t &beat) {
+    #pragma HLS INLINE off
+    #pragma HLS PIPELINE II=1
+    
+    // Source and destination are different banks, so this never collides
+    // with read_beat() in the same cycle
+    if (write_ptr < ACT_BUF_DEPTH) {
+        memory[write_bank][write_ptr] = beat;
+        write_ptr++;
+        fill[write_bank] = write_ptr;
+    }
+}
+
+/******************************************************************************
+ * SKIP BUFFER IMPLEMENTATION
+ ******************************************************************************/
+
+SkipBuffer::SkipBuffer() {
+    #pragma HLS BIND_STORAGE variable=memory type=RAM_2P impl=BRAM
+    
+    fill = 0;
+    read_ptr = 0;
+    write_ptr = 0;
+}
+
+void SkipBuffer::begin_layer(ActivationRoute route) {
+    #pragma HLS INLINE
+    
+    if (route.skip_add) {
+        read_ptr = 0;
+    }
+    
+    if (route.skip_save) {
+        write_ptr = 0;
+        if (!route.skip_add) {
+            fill = 0;
+        }
+    }
+}
+
+bool SkipBuffer::read_beat(axis_beat_t &beat) {
+    #pragma HLS INLINE off
+    #pragma HLS PIPELINE II=1
+    
+    if (read_ptr >= fill) {
+        return false;
+    }
+    
+    beat = memory[read_ptr];
+    read_ptr++;
+    return true;
+}
+
+void SkipBuffer::write_beat(const axis_beat_t &beat) {
+    #pragma HLS INLINE off
+    #pragma HLS PIPELINE II=1
+    
+    // A layer that adds and saves replaces the map beat by beat: beat k is
+    // read before it is overwritten, so the stored length is kept
+    if (write_ptr < SKIP_BUF_DEPTH) {
+        memory[write_ptr] = beat;
+        write_ptr++;
+        if (write_ptr > fill) {
+            fill = write_ptr;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+/******************************************************************************
+ * @file activation_buffer.h
+ * @brief On-chip activation buffer header
+ * @description Two-bank (ping-pong) global buffer keeping intermediate feature maps on chip
+ ******************************************************************************/
+
+#ifndef ACTIVATION_BUFFER_H
+#define ACTIVATION_BUFFER_H
+
+#include "../include/cnn_types.h"
+
+/******************************************************************************
+ * ACTIVATION BUFFER CLASS
+ ******************************************************************************/
+
+class ActivationBuffer {
+private:
+    // Two banks of packed beats: layer l writes one, layer l+1 reads it
+    axis_beat_t memory[2][ACT_BUF_DEPTH];
+    
+    // Beats currently held by each bank
+    large_addr_t fill[2];
+    
+    // Current layer routing and pointers
+    ap_uint<1> read_bank;
+    ap_uint<1> write_bank;
+    large_addr_t read_ptr;
+    large_addr_t write_ptr;
+    
+public:
+    ActivationBuffer();
+    
+    // Select source/destination banks for a new layer
+    void begin_layer(ActivationRoute route);
+    
+    // Next beat of the source bank (false once the stored map is exhausted)
+    bool read_beat(axis_beat_t &beat);
+    
+    // Replay the source bank from its first beat (FC neuron groups)
+    void rewind();
+    
+    // Append a beat to the destination bank
+    void write_beat(const axis_beat_t &beat);
+};
+
+/******************************************************************************
+ * SKIP BUFFER CLASS
+ ******************************************************************************/
+
+class SkipBuffer {
+private:
+    // One saved feature map (residual branch), packed like the output stream
+    axis_beat_t memory[SKIP_BUF_DEPTH];
+    
+    // Beats currently held
+    large_addr_t fill;
+    
+    large_addr_t read_ptr;
+    large_addr_t write_ptr;
+    
+public:
+    SkipBuffer();
+    
+    // A residual add replays the saved map from its first beat; a layer
+    // tagged save_output overwrites it (in place when it also adds)
+    void begin_layer(ActivationRoute route);
+    
+    // Next saved beat (false once the saved map is exhausted)
+    bool read_beat(axis_beat_t &beat);
+    
+    // Append a beat to the saved map
+    void write_beat(const axis_beat_t &beat);
+};
+
+#endif // ACTIVATION_BUFFER_H
@@ -76,10 +76,19 @@ void cuc(
     switch (state) {
         case CUC_IDLE:
             if (is_fc_last && valid_in) {
-                // Start classification
+                // Start classification: reset CNG and ACSU, which take this
+                // first class in the same cycle
                 state = CUC_ACTIVE;
-                class_counter = 0;
-                reset = true;  // Reset CNG and ACSU
+                class_counter = 1;
+                current_class_count = class_counter;
+                reset = true;
+                cng_enable = true;
+                acsu_enable = true;
+                
+                if (class_counter >= num_classes) {
+                    state = CUC_DONE;
+                    classification_done = true;
+                }
             }
             break;
         
@@ -129,7 +138,8 @@ void cng(
     #pragma HLS RESET variable=counter
     
     if (reset) {
-        counter = 0;
+        // With enable the first class takes number 0
+        counter = enable ? 1 : 0;
         class_number = 0;
     } else if (enable) {
         // Output current counter value (CNi)
@@ -156,7 +166,7 @@ void acsu(
     #pragma HLS PIPELINE II=1
     
     // REG1: Stores ACMax (maximum activation seen so far)
-    static data_t reg_ac_max = TO_FIXED(-1000);  // Initialize to very negative value
+    static data_t reg_ac_max = DATA_MIN;  // Most negative data_t value
     #pragma HLS RESET variable=reg_ac_max
     
     // REG2: Stores CN-DC (class number of maximum activation)
@@ -164,8 +174,8 @@ void acsu(
     #pragma HLS RESET variable=reg_class_num
     
     if (reset) {
-        // Reset registers
-        reg_ac_max = TO_FIXED(-1000);
+        // Reset registers; with enable the search starts from this input
+        reg_ac_max = enable ? ac_in : DATA_MIN;
         reg_class_num = 0;
         ac_max = reg_ac_max;
         class_number_out = reg_class_num;
@@ -7,41 +7,29 @@
 #include "cnn_inference_engine.h"
 
 /******************************************************************************
- * TOP-LEVEL CNN INFERENCE ENGINE IMPLEMENTATION
+ * SHARED INFERENCE CORE (IEC + KPU + CU)
  ******************************************************************************/
 
-void cnn_inference_engine(
-    hls::stream<data_t> &input_stream,
-    hls::stream<data_t> &weight_stream,
+void inference_core(
+    hls::stream<axis_beat_t> &input_stream,
+    hls::stream<axis_beat_t> &weight_stream,
     hls::stream<data_t> &bias_stream,
-    hls::stream<data_t> &output_stream,
+    hls::stream<axis_beat_t> &output_stream,
     LayerConfig layer_configs[MAX_LAYERS],
     int num_layers,
+    int batch_size,
     bool start,
+    ap_uint<16> fetched_beats,
+    DMARequest &dma_req,
     bool &done,
     bool &interrupt,
     int &class_number,
     int &current_layer,
     int &current_iteration,
-    ap_uint<32> &total_cycles
+    ap_uint<32> &total_cycles,
+    ap_uint<32> &skipped_macs
 ) {
-    // HLS Interface Pragmas
-    #pragma HLS INTERFACE axis port=input_stream
-    #pragma HLS INTERFACE axis port=weight_stream
-    #pragma HLS INTERFACE axis port=bias_stream
-    #pragma HLS INTERFACE axis port=output_stream
-    
-    #pragma HLS INTERFACE s_axilite port=layer_configs bundle=control
-    #pragma HLS INTERFACE s_axilite port=num_layers bundle=control
-    #pragma HLS INTERFACE s_axilite port=start bundle=control
-    #pragma HLS INTERFACE s_axilite port=done bundle=control
-    #pragma HLS INTERFACE s_axilite port=interrupt bundle=control
-    #pragma HLS INTERFACE s_axilite port=class_number bundle=control
-    #pragma HLS INTERFACE s_axilite port=current_layer bundle=control
-    #pragma HLS INTERFACE s_axilite port=current_iteration bundle=control
-    #pragma HLS INTERFACE s_axilite port=total_cycles bundle=control
-    #pragma HLS INTERFACE s_axilite port=return bundle=control
-    
+    #pragma HLS INLINE
     #pragma HLS DATAFLOW
     
     // =========================================================================
@@ -60,6 +48,7 @@ void cnn_inference_engine(
     static bool prefetch_active;
     static bool compute_active;
     static LayerConfig current_config;
+    static ActivationRoute act_route;
     static bool iec_done;
     static bool iec_interrupt;
     static int final_class;
@@ -68,7 +57,9 @@ void cnn_inference_engine(
     
     // KPU status signals
     static bool kpu_done;
+    static bool kpu_pass_start;
     static ap_uint<32> kpu_cycles;
+    static ap_uint<32> kpu_skipped;
     
     // CU status signals
     static bool cu_classification_done;
@@ -91,14 +82,19 @@ void cnn_inference_engine(
     iec_controller(
         layer_configs,
         num_layers,
+        batch_size,
         start,
         kpu_done,
+        kpu_pass_start,
         cu_classification_done,
         cu_class_number,
+        fetched_beats,
         kpu_start,
         prefetch_active,
         compute_active,
         current_config,
+        act_route,
+        dma_req,
         iec_done,
         iec_interrupt,
         final_class,
@@ -111,7 +107,7 @@ void cnn_inference_engine(
     // =========================================================================
     
     // Create intermediate stream for KPU output
-    static hls::stream<data_t> kpu_output("kpu_output");
+    static hls::stream<axis_beat_t> kpu_output("kpu_output");
     #pragma HLS STREAM variable=kpu_output depth=128
     
     pe_array(
@@ -120,26 +116,43 @@ void cnn_inference_engine(
         bias_stream,
         kpu_output,
         current_config,
+        act_route,
+        batch_size,
         kpu_start,
         kpu_done,
-        kpu_cycles
+        kpu_pass_start,
+        kpu_cycles,
+        kpu_skipped
     );
     
-    // Connect KPU output to CU input
-    static data_t kpu_data;
-    static bool kpu_data_valid = false;
+    // Route KPU output beats: feature maps leave packed, bypassing the CU;
+    // the FClast layer is unpacked so the CU sees one activation per cycle.
+    // Output rows start on beat boundaries, so only the lanes holding row
+    // elements go to the CU (an FC row is output_w neurons, the rest of
+    // its beat is zero padding)
+    static ap_uint<10> cu_col = 0;
     
     if (!kpu_output.empty()) {
-        kpu_data = kpu_output.read();
-        kpu_data_valid = true;
+        axis_beat_t kpu_beat = kpu_output.read();
         
-        // Write to stream for CU
-        if (!kpu_to_cu_stream.full()) {
-            kpu_to_cu_stream.write(kpu_data);
-            kpu_valid_stream.write(true);
+        if (current_config.is_fc_last) {
+            ap_uint<10> row_left = current_config.output_w - cu_col;
+            idx_t lanes = (row_left < AXIS_LANES) ? (idx_t)row_left : (idx_t)AXIS_LANES;
+            
+            for (int l = 0; l < AXIS_LANES; l++) {
+                if (l < lanes) {
+                    kpu_to_cu_stream.write(kpu_beat.lane[l]);
+                    kpu_valid_stream.write(true);
+                }
+            }
+            
+            cu_col += lanes;
+            if (cu_col >= current_config.output_w) {
+                cu_col = 0;
+            }
+        } else if (!output_stream.full()) {
+            output_stream.write(kpu_beat);
         }
-    } else {
-        kpu_data_valid = false;
     }
     
     // =========================================================================
@@ -174,16 +187,12 @@ void cnn_inference_engine(
     // =========================================================================
     
     // Route output based on whether classification is active
+    // (normal-layer activations were already forwarded as packed beats)
     if (cu_classification_done) {
         // Classification layer: Output class number
         // The actual activation values can be optionally output as well
         // For now, we just signal completion via class_number
         class_number = cu_class_number;
-    } else if (cu_output_valid) {
-        // Normal layer: Output activations/partial sums
-        if (!output_stream.full()) {
-            output_stream.write(cu_output_data);
-        }
     }
     
     // =========================================================================
@@ -200,4 +209,184 @@ void cnn_inference_engine(
         cycle_counter++;
     }
     total_cycles = cycle_counter;
+    skipped_macs = kpu_skipped;
+}
+
+
+/******************************************************************************
+ * TOP-LEVEL CNN INFERENCE ENGINE IMPLEMENTATION (AXI4-STREAM MODE)
+ ******************************************************************************/
+
+void cnn_inference_engine(
+    hls::stream<axis_beat_t> &input_stream,
+    hls::stream<axis_beat_t> &weight_stream,
+    hls::stream<data_t> &bias_stream,
+    hls::stream<axis_beat_t> &output_stream,
+    LayerConfig layer_configs[MAX_LAYERS],
+    int num_layers,
+    int batch_size,
+    bool start,
+    bool &done,
+    bool &interrupt,
+    int &class_number,
+    int &current_layer,
+    int &current_iteration,
+    ap_uint<32> &total_cycles,
+    ap_uint<32> &skipped_macs
+) {
+    // HLS Interface Pragmas
+    #pragma HLS INTERFACE axis port=input_stream
+    #pragma HLS INTERFACE axis port=weight_stream
+    #pragma HLS INTERFACE axis port=bias_stream
+    #pragma HLS INTERFACE axis port=output_stream
+    
+    #pragma HLS INTERFACE s_axilite port=layer_configs bundle=control
+    #pragma HLS INTERFACE s_axilite port=num_layers bundle=control
+    #pragma HLS INTERFACE s_axilite port=batch_size bundle=control
+    #pragma HLS INTERFACE s_axilite port=start bundle=control
+    #pragma HLS INTERFACE s_axilite port=done bundle=control
+    #pragma HLS INTERFACE s_axilite port=interrupt bundle=control
+    #pragma HLS INTERFACE s_axilite port=class_number bundle=control
+    #pragma HLS INTERFACE s_axilite port=current_layer bundle=control
+    #pragma HLS INTERFACE s_axilite port=current_iteration bundle=control
+    #pragma HLS INTERFACE s_axilite port=total_cycles bundle=control
+    #pragma HLS INTERFACE s_axilite port=skipped_macs bundle=control
+    #pragma HLS INTERFACE s_axilite port=return bundle=control
+    
+    // Burst requests are unused: the host pushes all data through the
+    // streams, so the IEC assumes one input beat delivered per cycle
+    DMARequest dma_req;
+    
+    inference_core(
+        input_stream,
+        weight_stream,
+        bias_stream,
+        output_stream,
+        layer_configs,
+        num_layers,
+        batch_size,
+        start,
+        1,
+        dma_req,
+        done,
+        interrupt,
+        class_number,
+        current_layer,
+        current_iteration,
+        total_cycles,
+        skipped_macs
+    );
+}
+
+/******************************************************************************
+ * TOP-LEVEL CNN INFERENCE ENGINE IMPLEMENTATION (m_axi DDR MASTER MODE)
+ ******************************************************************************/
+
+void cnn_inference_engine_ddr(
+    axis_beat_t *ddr,
+    LayerConfig layer_configs[MAX_LAYERS],
+    int num_layers,
+    int batch_size,
+    bool start,
+    bool &done,
+    bool &interrupt,
+    int &class_number,
+    int &current_layer,
+    int &current_iteration,
+    ap_uint<32> &total_cycles,
+    ap_uint<32> &skipped_macs
+) {
+    // HLS Interface Pragmas
+    #pragma HLS INTERFACE m_axi port=ddr offset=slave bundle=gmem \
+        max_read_burst_length=256 max_write_burst_length=256 \
+        num_read_outstanding=4 num_write_outstanding=4
+    #pragma HLS INTERFACE s_axilite port=ddr bundle=control
+    
+    #pragma HLS INTERFACE s_axilite port=layer_configs bundle=control
+    #pragma HLS INTERFACE s_axilite port=num_layers bundle=control
+    #pragma HLS INTERFACE s_axilite port=batch_size bundle=control
+    #pragma HLS INTERFACE s_axilite port=start bundle=control
+    #pragma HLS INTERFACE s_axilite port=done bundle=control
+    #pragma HLS INTERFACE s_axilite port=interrupt bundle=control
+    #pragma HLS INTERFACE s_axilite port=class_number bundle=control
+    #pragma HLS INTERFACE s_axilite port=current_layer bundle=control
+    #pragma HLS INTERFACE s_axilite port=current_iteration bundle=control
+    #pragma HLS INTERFACE s_axilite port=total_cycles bundle=control
+    #pragma HLS INTERFACE s_axilite port=skipped_macs bundle=control
+    #pragma HLS INTERFACE s_axilite port=return bundle=control
+    
+    // =========================================================================
+    // Internal Streams (filled/drained by burst DMA)
+    // =========================================================================
+    
+    // Input: one burst in flight plus the one being consumed
+    static hls::stream<axis_beat_t> input_fifo("ddr_input");
+    #pragma HLS STREAM variable=input_fifo depth=512
+    
+    // Weights/biases: the active filter group plus the one being pre-loaded
+    static hls::stream<axis_beat_t> weight_fifo("ddr_weight");
+    #pragma HLS STREAM variable=weight_fifo depth=2*WEIGHT_GROUP_MAX_BEATS
+    
+    static hls::stream<data_t> bias_fifo("ddr_bias");
+    #pragma HLS STREAM variable=bias_fifo depth=2*N_SIZE
+    
+    static hls::stream<axis_beat_t> output_fifo("ddr_output");
+    #pragma HLS STREAM variable=output_fifo depth=512
+    
+    // Burst handshake with the IEC pre-fetch algorithm
+    static DMARequest dma_req;
+    static ap_uint<16> fetched_beats = 0;
+    static ap_uint<32> output_addr = 0;
+    #pragma HLS RESET variable=fetched_beats
+    
+    inference_core(
+        input_fifo,
+        weight_fifo,
+        bias_fifo,
+        output_fifo,
+        layer_configs,
+        num_layers,
+        batch_size,
+        start,
+        fetched_beats,
+        dma_req,
+        done,
+        interrupt,
+        class_number,
+        current_layer,
+        current_iteration,
+        total_cycles,
+        skipped_macs
+    );
+    
+    // =========================================================================
+    // Serve IEC burst requests
+    // =========================================================================
+    
+    fetched_beats = 0;
+    
+    if (dma_req.input_valid) {
+        dma_read_beats(ddr, dma_req.input_addr, dma_req.input_beats, input_fifo);
+        fetched_beats = dma_req.input_beats;
+    }
+    
+    if (dma_req.weight_valid) {
+        dma_read_beats(ddr, dma_req.weight_addr, dma_req.weight_beats, weight_fifo);
+    }
+    
+    if (dma_req.bias_valid) {
+        dma_read_bias(ddr, dma_req.bias_addr, bias_fifo);
+    }
+    
+    // =========================================================================
+    // Output write-back
+    // =========================================================================
+    
+    if (dma_req.output_restart) {
+        output_addr = dma_req.output_addr;
+    }
+    
+    ap_uint<16> beats_written;
+    dma_write_beats(ddr, output_addr, output_fifo, beats_written);
+    output_addr += beats_written;
 }
@@ -11,21 +11,80 @@
 #include "iec_controller.h"
 #include "pe_array.h"
 #include "classify_unit.h"
+#include "dma_engine.h"
 
 /******************************************************************************
- * TOP-LEVEL CNN INFERENCE ENGINE
+ * SHARED INFERENCE CORE (used by both top-level variants)
+ ******************************************************************************/
+
+void inference_core(
+    hls::stream<axis_beat_t> &input_stream,
+    hls::stream<axis_beat_t> &weight_stream,
+    hls::stream<data_t> &bias_stream,
+    hls::stream<axis_beat_t> &output_stream,
+    LayerConfig layer_configs[MAX_LAYERS],
+    int num_layers,
+    int batch_size,
+    bool start,
+    ap_uint<16> fetched_beats,      // Input beats delivered last cycle
+    DMARequest &dma_req,            // Burst requests from the IEC
+    bool &done,
+    bool &interrupt,
+    int &class_number,
+    int &current_layer,
+    int &current_iteration,
+    ap_uint<32> &total_cycles,
+    ap_uint<32> &skipped_macs       // Zero-skip MACs gated (current layer)
+);
+
+/******************************************************************************
+ * TOP-LEVEL CNN INFERENCE ENGINE (AXI4-STREAM MODE)
  ******************************************************************************/
 
 void cnn_inference_engine(
-    // AXI4-Stream interfaces for data I/O
-    hls::stream<data_t> &input_stream,
-    hls::stream<data_t> &weight_stream,
+    // AXI4-Stream interfaces for data I/O (AXIS_WIDTH-bit packed beats;
+    // biases stay one value per beat)
+    hls::stream<axis_beat_t> &input_stream,
+    hls::stream<axis_beat_t> &weight_stream,
     hls::stream<data_t> &bias_stream,
-    hls::stream<data_t> &output_stream,
+    hls::stream<axis_beat_t> &output_stream,
+    
+    // AXI4-Lite interface for configuration
+    LayerConfig layer_configs[MAX_LAYERS],
+    int num_layers,
+    int batch_size,                 // Images per batch; layer l runs over all
+                                    // of them before layer l+1 (0 = 1)
+    
+    // Control signals
+    bool start,
+    bool &done,
+    bool &interrupt,
+    
+    // Classification output
+    int &class_number,
+    
+    // Status outputs
+    int &current_layer,
+    int &current_iteration,
+    ap_uint<32> &total_cycles,
+    ap_uint<32> &skipped_macs       // Zero-skip MACs gated (current layer)
+);
+
+/******************************************************************************
+ * TOP-LEVEL CNN INFERENCE ENGINE (m_axi DDR MASTER MODE)
+ * Fetches inputs, weights and biases from per-layer DDR base addresses
+ * (LayerConfig::*_base) and writes outputs back with long bursts
+ ******************************************************************************/
+
+void cnn_inference_engine_ddr(
+    // AXI4 master interface to DDR (all addresses in axis_beat_t units)
+    axis_beat_t *ddr,
     
     // AXI4-Lite interface for configuration
     LayerConfig layer_configs[MAX_LAYERS],
     int num_layers,
+    int batch_size,                 // Images per batch; layer l runs over all
+                                    // of them before layer l+1 (0 = 1)
     
     // Control signals
     bool start,
@@ -38,7 +97,8 @@ void cnn_inference_engine(
     // Status outputs
     int &current_layer,
     int &current_iteration,
-    ap_uint<32> &total_cycles
+    ap_uint<32> &total_cycles,
+    ap_uint<32> &skipped_macs       // Zero-skip MACs gated (current layer)
 );
 
 #endif // CNN_INFERENCE_ENGINE_H
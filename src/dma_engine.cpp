@@ -0,0 +1,75 @@
+/******************************************************************************
+ * @file dma_engine.cpp
+ * @brief DDR burst DMA implementation
+ * @description Pipelined copy loops over consecutive beats, inferred as long AXI4 bursts
+ ******************************************************************************/
+
+#include "dma_engine.h"
+
+/******************************************************************************
+ * BURST READ IMPLEMENTATION
+ ******************************************************************************/
+
+void dma_read_beats(
+    const axis_beat_t *ddr,
+    ap_uint<32> addr,
+    ap_uint<16> beats,
+    hls::stream<axis_beat_t> &out
+) {
+    #pragma HLS INLINE off
+    
+    // Consecutive addresses in a II=1 loop: HLS infers INCR bursts, split
+    // at DMA_MAX_BURST beats by the m_axi adapter
+    for (ap_uint<16> b = 0; b < beats; b++) {
+        #pragma HLS PIPELINE II=1
+        #pragma HLS LOOP_TRIPCOUNT min=1 max=WEIGHT_GROUP_MAX_BEATS
+        out.write(ddr[addr + b]);
+    }
+}
+
+void dma_read_bias(
+    const axis_beat_t *ddr,
+    ap_uint<32> addr,
+    hls::stream<data_t> &out
+) {
+    #pragma HLS INLINE off
+    
+    // Unpack the group's bias beats into one value per filter column
+    for (int b = 0; b < BIAS_GROUP_BEATS; b++) {
+        #pragma HLS PIPELINE II=AXIS_LANES
+        axis_beat_t beat = ddr[addr + b];
+        
+        for (int l = 0; l < AXIS_LANES; l++) {
+            if (b * AXIS_LANES + l < N_SIZE) {
+                out.write(beat.lane[l]);
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * BURST WRITE IMPLEMENTATION
+ ******************************************************************************/
+
+void dma_write_beats(
+    axis_beat_t *ddr,
+    ap_uint<32> addr,
+    hls::stream<axis_beat_t> &in,
+    ap_uint<16> &beats_written
+) {
+    #pragma HLS INLINE off
+    
+    // Drain whatever output is available, up to one full burst
+    ap_uint<16> count = 0;
+    
+    for (int b = 0; b < DMA_MAX_BURST; b++) {
+        #pragma HLS PIPELINE II=1
+        if (in.empty()) {
+            break;
+        }
+        ddr[addr + b] = in.read();
+        count++;
+    }
+    
+    beats_written = count;
+}
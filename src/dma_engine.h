@@ -0,0 +1,51 @@
+/******************************************************************************
+ * @file dma_engine.h
+ * @brief DDR burst DMA header
+ * @description m_axi burst readers/writers feeding the KPU streams in DDR master mode
+ ******************************************************************************/
+
+#ifndef DMA_ENGINE_H
+#define DMA_ENGINE_H
+
+#include "../include/cnn_types.h"
+
+/******************************************************************************
+ * DMA CONFIGURATION
+ ******************************************************************************/
+
+// Beats per filter group: N_SIZE beat-aligned filters of at most WEIGHT_MEM_DEPTH
+// entries, each value beat followed by a metadata beat for compressed weights
+#define WEIGHT_GROUP_MAX_BEATS (2 * N_SIZE * ((WEIGHT_MEM_DEPTH + AXIS_LANES - 1) / AXIS_LANES))
+
+// Beats per filter group of biases (N_SIZE values, beat-aligned)
+#define BIAS_GROUP_BEATS ((N_SIZE + AXIS_LANES - 1) / AXIS_LANES)
+
+/******************************************************************************
+ * BURST READ: DDR -> STREAM
+ ******************************************************************************/
+
+void dma_read_beats(
+    const axis_beat_t *ddr,         // DDR master port
+    ap_uint<32> addr,               // Start address (beats)
+    ap_uint<16> beats,              // Transfer length (beats)
+    hls::stream<axis_beat_t> &out   // Destination stream
+);
+
+void dma_read_bias(
+    const axis_beat_t *ddr,         // DDR master port
+    ap_uint<32> addr,               // Start address (beats)
+    hls::stream<data_t> &out        // Destination stream (N_SIZE values)
+);
+
+/******************************************************************************
+ * BURST WRITE: STREAM -> DDR
+ ******************************************************************************/
+
+void dma_write_beats(
+    axis_beat_t *ddr,               // DDR master port
+    ap_uint<32> addr,               // Start address (beats)
+    hls::stream<axis_beat_t> &in,   // Source stream
+    ap_uint<16> &beats_written      // Beats drained this call
+);
+
+#endif // DMA_ENGINE_H
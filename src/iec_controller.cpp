@@ -18,6 +18,26 @@ IECController::IECController() {
     iterations_per_layer = 0;
     data_fetched = 0;
     data_required = 0;
+    fetch_iteration = 0;
+    beats_per_iteration = 0;
+    beats_requested = 0;
+    burst_wait = 0;
+    weight_groups_requested = 0;
+    weight_group_beats = 0;
+    weight_beats_requested = 0;
+    weight_burst_wait = 0;
+    batch_size = 1;
+    fetch_image = 0;
+    fetch_offset = 0;
+    weight_image = 0;
+    out_group = 0;
+    out_image = 0;
+    out_group_beats = 0;
+    group_iterations = 1;
+    fetch_group = 0;
+    fetch_group_iter = 0;
+    prev_dst_on_chip = false;
+    prev_dst_bank = 0;
     classification_result = -1;
     classification_complete = false;
 }
@@ -29,21 +49,163 @@ void IECController::reset() {
     current_layer_idx = 0;
     current_iteration = 0;
     data_fetched = 0;
+    fetch_iteration = 0;
+    beats_requested = 0;
+    burst_wait = 0;
+    weight_groups_requested = 0;
+    weight_beats_requested = 0;
+    weight_burst_wait = 0;
+    fetch_image = 0;
+    fetch_offset = 0;
+    weight_image = 0;
+    out_group = 0;
+    out_image = 0;
+    fetch_group = 0;
+    fetch_group_iter = 0;
+    route = ActivationRoute();
+    prev_dst_on_chip = false;
     classification_result = -1;
     classification_complete = false;
 }
 
+void IECController::next_fetch_iteration() {
+    #pragma HLS INLINE
+    
+    fetch_iteration++;
+    fetch_image = 0;
+    fetch_offset = 0;
+    beats_requested = 0;
+    data_fetched = 0;
+    
+    // Grouped convolution: every group_iterations filter groups the fetch
+    // moves on to the next group's input channel slice
+    fetch_group_iter++;
+    if (fetch_group_iter == group_iterations) {
+        fetch_group_iter = 0;
+        fetch_group++;
+    }
+}
+
+void IECController::request_bursts(const LayerConfig &config, DMARequest &dma_req) {
+    #pragma HLS INLINE
+    
+    // Input: one burst outstanding at a time for the iteration being fetched;
+    // the next burst is issued once the previous one has drained into the KPU.
+    // Inputs held in the on-chip activation buffer need no fetch at all
+    if (route.src_on_chip) {
+        beats_requested = beats_per_iteration;
+    } else if (burst_wait > 0) {
+        burst_wait--;
+    } else if (beats_requested < beats_per_iteration) {
+        ap_uint<32> remaining = beats_per_iteration - beats_requested;
+        ap_uint<16> beats = (remaining < DMA_MAX_BURST) ?
+                            (ap_uint<16>)remaining : (ap_uint<16>)DMA_MAX_BURST;
+        
+        // An FC chunk of several images shares every weight beat, so the PE
+        // array takes their inputs interleaved beat by beat
+        ap_uint<8> images_left = batch_size - fetch_image;
+        ap_uint<3> chunk_images = (images_left < FC_BATCH_MAX) ? (ap_uint<3>)images_left :
+                                                                 (ap_uint<3>)FC_BATCH_MAX;
+        bool interleave = (config.layer_type == FC) && (chunk_images > 1);
+        if (interleave) {
+            beats = 1;
+        }
+        
+        dma_req.input_valid = true;
+        // Each iteration fetches its own slice of the input; pointwise and
+        // FC iterations all re-read the full map, grouped-convolution
+        // iterations their group's channel slice. Batch images are
+        // input_batch_stride beats apart
+        bool full_map = IS_POINTWISE(config) || (config.layer_type == FC);
+        ap_uint<32> iteration_offset;
+        if (config.groups > 1) {
+            iteration_offset = fetch_group * beats_per_iteration;
+        } else if (full_map) {
+            iteration_offset = 0;
+        } else {
+            iteration_offset = (fetch_iteration - 1) * beats_per_iteration;
+        }
+        dma_req.input_addr = config.input_base +
+                             (fetch_image + fetch_offset) * config.input_batch_stride +
+                             iteration_offset + beats_requested;
+        dma_req.input_beats = beats;
+        
+        if (interleave) {
+            fetch_offset++;
+            if (fetch_offset == chunk_images) {
+                fetch_offset = 0;
+                beats_requested++;
+            }
+        } else {
+            beats_requested += beats;
+        }
+        burst_wait = beats;
+    }
+    
+    // Weights: stay one filter group ahead of the iteration being computed,
+    // so the KPC can pre-load its idle weight bank. Pooling layers have none
+    if (config.layer_type == FC) {
+        // FC streaming: weights (bias rows included) are consumed as they
+        // arrive, so they are fetched like the input, one burst outstanding.
+        // Nothing stays resident, so every chunk of FC_BATCH_MAX images of a
+        // batch re-streams the neuron group's weights
+        if (weight_burst_wait > 0) {
+            weight_burst_wait--;
+        } else if (weight_groups_requested < iterations_per_layer) {
+            ap_uint<32> remaining = weight_group_beats - weight_beats_requested;
+            ap_uint<16> beats = (remaining < DMA_MAX_BURST) ?
+                                (ap_uint<16>)remaining : (ap_uint<16>)DMA_MAX_BURST;
+            
+            dma_req.weight_valid = true;
+            dma_req.weight_addr = config.weight_base +
+                                  weight_groups_requested * weight_group_beats +
+                                  weight_beats_requested;
+            dma_req.weight_beats = beats;
+            
+            weight_beats_requested += beats;
+            weight_burst_wait = beats;
+            
+            if (weight_beats_requested == weight_group_beats) {
+                weight_beats_requested = 0;
+                ap_uint<9> next_image = weight_image + FC_BATCH_MAX;
+                if (next_image < batch_size) {
+                    weight_image = next_image;
+                } else {
+                    weight_image = 0;
+                    weight_groups_requested++;
+                }
+            }
+        }
+    } else if (!IS_WEIGHTLESS(config) &&
+               weight_groups_requested <= current_iteration &&
+               weight_groups_requested < iterations_per_layer) {
+        dma_req.weight_valid = true;
+        dma_req.weight_addr = config.weight_base + weight_groups_requested * weight_group_beats;
+        dma_req.weight_beats = weight_group_beats;
+        dma_req.bias_addr = config.bias_base +
+                            weight_groups_requested * ((N_SIZE + AXIS_LANES - 1) / AXIS_LANES);
+        dma_req.bias_valid = true;
+        
+        weight_groups_requested++;
+    }
+}
+
 void IECController::control(
     LayerConfig layer_configs[MAX_LAYERS],
     int num_layers,
+    ap_uint<8> batch,
     bool start,
     bool kpu_done,
+    bool kpu_pass_start,
     bool cu_classification_done,
     int cu_class_number,
+    ap_uint<16> fetched_beats,
     bool &kpu_start,
     bool &prefetch_active,
     bool &compute_active,
     LayerConfig &current_config,
+    ActivationRoute &act_route,
+    DMARequest &dma_req,
     bool &done,
     bool &interrupt,
     int &final_class,
@@ -59,6 +221,8 @@ void IECController::control(
     compute_active = false;
     done = false;
     interrupt = false;
+    dma_req = DMARequest();
+    act_route = route;
     
     // FSM State Machine
     switch (current_state) {
@@ -66,9 +230,13 @@ void IECController::control(
         case IEC_IDLE:
             // Wait for start signal
             if (start) {
-                current_state = IEC_CONFIG;
+                // Reject an unsupported first layer before anything runs
+                current_state = LAYER_UNSUPPORTED(layer_configs[0]) ? IEC_DONE : IEC_CONFIG;
+                classification_result = -1;
                 current_layer_idx = 0;
                 total_layers = num_layers;
+                batch_size = (batch == 0) ? (ap_uint<8>)1 : batch;
+                prev_dst_on_chip = false;
                 current_iteration = 1;  // i = 1 in algorithm
                 data_fetched = 0;       // j = 0 in algorithm
             }
@@ -84,6 +252,129 @@ void IECController::control(
             data_fetched = 0;
             current_iteration = 1;
             
+            // Burst geometry: rows and filters start on beat boundaries
+            {
+                ap_uint<16> row_beats = (current_config.input_w + AXIS_LANES - 1) / AXIS_LANES;
+                
+                // Grouped convolution: nl covers all groups, each owning
+                // nl / groups filter groups and input_c / groups channels
+                ap_uint<11> groups = (current_config.groups == 0) ?
+                                     (ap_uint<11>)1 : current_config.groups;
+                group_iterations = iterations_per_layer / groups;
+                if (group_iterations == 0) {
+                    group_iterations = 1;
+                }
+                bool sparse = (current_config.weight_entries != 0);
+                bool weight_stationary = IS_WEIGHT_STATIONARY(current_config);
+                ap_uint<16> filter_size = PE_FILTER_SIZE(current_config);
+                
+                // Depthwise and windowed-pooling iterations fetch only their
+                // own channel group, N_SIZE channels interleaved per pixel
+                if (IS_CHANNEL_WISE(current_config)) {
+                    beats_per_iteration = current_config.input_h *
+                        ((current_config.input_w * N_SIZE + AXIS_LANES - 1) / AXIS_LANES);
+                } else if (current_config.layer_type == FC) {
+                    // FC streaming: every neuron group re-reads the whole input
+                    beats_per_iteration = current_config.input_h * current_config.input_c *
+                                          row_beats;
+                } else if (IS_POINTWISE(current_config)) {
+                    // Pointwise: every filter group streams all pixels, one
+                    // channel vector (beat-aligned, kernel_d channels: the
+                    // group's slice) per pixel
+                    beats_per_iteration = current_config.input_h * current_config.input_w *
+                        ((current_config.kernel_d + AXIS_LANES - 1) / AXIS_LANES);
+                } else if (groups > 1) {
+                    // Grouped: every filter group of a conv group re-reads
+                    // that group's channel slice
+                    beats_per_iteration = current_config.input_h * row_beats *
+                                          (current_config.input_c / groups);
+                } else {
+                    beats_per_iteration = current_config.input_h * current_config.input_c *
+                                          row_beats / iterations_per_layer;
+                }
+                
+                // Compressed filters send a metadata beat after each value beat;
+                // an FC neuron group streams one weight per PE for every input
+                // element plus the bias row; weight-stationary filters start
+                // every kernel row on a fresh beat
+                if (current_config.layer_type == FC) {
+                    weight_group_beats = (current_config.input_h * current_config.input_w *
+                                          current_config.input_c + 1) * FC_BEATS_PER_INPUT;
+                } else if (weight_stationary) {
+                    weight_group_beats = N_SIZE * current_config.kernel_h *
+                                         ((filter_size + AXIS_LANES - 1) / AXIS_LANES);
+                } else {
+                    weight_group_beats = N_SIZE * ((filter_size + AXIS_LANES - 1) / AXIS_LANES) *
+                                         (sparse ? 2 : 1);
+                }
+            }
+            fetch_iteration = 1;
+            fetch_group = 0;
+            fetch_group_iter = 0;
+            beats_requested = 0;
+            burst_wait = 0;
+            weight_groups_requested = 0;
+            weight_beats_requested = 0;
+            weight_burst_wait = 0;
+            fetch_image = 0;
+            fetch_offset = 0;
+            weight_image = 0;
+            out_group = 0;
+            out_image = 0;
+            
+            // Activation routing: intermediate feature maps ping-pong between
+            // the two on-chip banks when they fit; only the first input and
+            // the final result cross the AXI boundary. A batch keeps its
+            // images in DDR, since the buffer only holds one map per bank
+            {
+                bool last_layer = (current_layer_idx == total_layers - 1) ||
+                                  current_config.is_fc_last;
+                ap_uint<32> out_row_beats = (current_config.output_w + AXIS_LANES - 1) / AXIS_LANES;
+                ap_uint<32> out_beats = current_config.output_h * current_config.output_c *
+                                        out_row_beats;
+                
+                // Pointwise maps hold one N_SIZE filter vector per pixel and
+                // group, depthwise maps rows of N_SIZE interleaved channels
+                if (IS_POINTWISE(current_config)) {
+                    out_beats = current_config.output_h * current_config.output_w *
+                                iterations_per_layer * ((N_SIZE + AXIS_LANES - 1) / AXIS_LANES);
+                } else if (IS_CHANNEL_WISE(current_config)) {
+                    out_beats = current_config.output_h * iterations_per_layer *
+                                ((current_config.output_w * N_SIZE + AXIS_LANES - 1) / AXIS_LANES);
+                }
+                
+                route.src_on_chip = prev_dst_on_chip;
+                route.src_bank = prev_dst_bank;
+                // A grouped next layer with several filter groups per conv
+                // group re-reads channel slices, which the sequential
+                // buffer cannot replay
+                LayerConfig next_config = layer_configs[last_layer ? current_layer_idx :
+                                                        current_layer_idx + 1];
+                bool next_rereads = (next_config.groups > 1) &&
+                                    (next_config.nl > next_config.groups);
+                
+                route.dst_on_chip = !last_layer && (batch_size == 1) && !next_rereads &&
+                                    (out_beats <= ACT_BUF_DEPTH);
+                route.dst_bank = ~prev_dst_bank;
+                
+                prev_dst_on_chip = route.dst_on_chip;
+                prev_dst_bank = route.dst_bank;
+                
+                // Residual branches stay on chip in the skip buffer: the
+                // saved map must fit it and holds a single image
+                route.skip_save = current_config.save_output && (batch_size == 1) &&
+                                  (out_beats <= SKIP_BUF_DEPTH);
+                route.skip_add = current_config.add_residual ||
+                                 (current_config.layer_type == ELTWISE_ADD);
+                
+                out_group_beats = out_beats / iterations_per_layer;
+            }
+            act_route = route;
+            
+            // Layer output is written back from its base address
+            dma_req.output_restart = true;
+            dma_req.output_addr = current_config.output_base;
+            
             // Move to pre-fetch state
             current_state = IEC_PREFETCH;
             break;
@@ -92,8 +383,10 @@ void IECController::control(
             // Pre-fetch rl data items (Step 3 in algorithm)
             prefetch_active = true;
             
-            // Simulate data fetching (in actual implementation, DMA would fetch)
-            data_fetched++;
+            // Issue input/weight bursts (served by the DDR master in m_axi
+            // mode) and count the data delivered to the KPU
+            request_bursts(current_config, dma_req);
+            data_fetched += (route.src_on_chip ? (ap_uint<16>)1 : fetched_beats) * AXIS_LANES;
             
             // Step 4: Wait until j >= rl
             if (data_fetched >= data_required) {
@@ -109,16 +402,43 @@ void IECController::control(
             prefetch_active = true;  // Continue fetching while computing
             
             // Continue fetching data
-            data_fetched++;
+            request_bursts(current_config, dma_req);
+            data_fetched += (route.src_on_chip ? (ap_uint<16>)1 : fetched_beats) * AXIS_LANES;
             
             // Step 6: If current fetch complete and not last iteration,
-            // start pre-fetching for next iteration
-            bool fetch_for_current_complete = (data_fetched >= current_config.input_h * current_config.input_w * current_config.input_c / iterations_per_layer);
+            // start pre-fetching for next iteration (after the current
+            // iteration's input has been fetched for every batch image)
+            bool fetch_for_current_complete = (beats_requested >= beats_per_iteration);
             bool not_last_iteration = (current_iteration < iterations_per_layer);
             
-            if (fetch_for_current_complete && not_last_iteration) {
-                // Start pre-fetching for iteration i+1
+            // An FC pass fetches a chunk of up to FC_BATCH_MAX images
+            ap_uint<9> next_image = fetch_image +
+                                    ((current_config.layer_type == FC) ? FC_BATCH_MAX : 1);
+            
+            if (fetch_for_current_complete && next_image < batch_size) {
+                // Next image (FC: chunk) of the batch, same filter group
+                fetch_image = next_image;
+                beats_requested = 0;
                 data_fetched = 0;
+            } else if (fetch_for_current_complete && not_last_iteration &&
+                       fetch_iteration == current_iteration) {
+                // Start pre-fetching for iteration i+1
+                next_fetch_iteration();
+            }
+            
+            // Each KPU pass writes one filter group of one image: move the
+            // write-back to that slice of the image's output map
+            if (kpu_pass_start) {
+                out_image++;
+                if (out_image == batch_size) {
+                    out_image = 0;
+                    out_group++;
+                }
+                
+                dma_req.output_restart = true;
+                dma_req.output_addr = current_config.output_base +
+                                      out_image * current_config.output_batch_stride +
+                                      out_group * out_group_beats;
             }
             
             // Step 7: When processing complete
@@ -140,6 +460,9 @@ void IECController::control(
                 } else {
                     // Continue processing activations for classification
                     current_iteration++;
+                    if (fetch_iteration < current_iteration) {
+                        next_fetch_iteration();
+                    }
                     if (current_iteration <= iterations_per_layer) {
                         current_state = IEC_PREFETCH;
                     } else {
@@ -154,9 +477,12 @@ void IECController::control(
                 if (current_iteration > iterations_per_layer) {
                     current_state = IEC_NEXT_LAYER;
                 } else {
-                    // More iterations for this layer
+                    // More iterations for this layer (input may already have
+                    // been pre-fetched during the previous iteration)
                     current_state = IEC_PREFETCH;
-                    data_fetched = 0;
+                    if (fetch_iteration < current_iteration) {
+                        next_fetch_iteration();
+                    }
                 }
             }
             break;
@@ -178,6 +504,11 @@ void IECController::control(
             if (current_layer_idx >= total_layers) {
                 current_state = IEC_DONE;
                 interrupt = true;  // Signal processor
+            } else if (LAYER_UNSUPPORTED(layer_configs[current_layer_idx])) {
+                // Stop the network; layer_out reports the rejected layer
+                current_state = IEC_DONE;
+                classification_result = -1;
+                interrupt = true;
             } else {
                 // Configure next layer
                 current_state = IEC_CONFIG;
@@ -204,14 +535,19 @@ void IECController::control(
 void iec_controller(
     LayerConfig layer_configs[MAX_LAYERS],
     int num_layers,
+    ap_uint<8> batch_size,
     bool start,
     bool kpu_done,
+    bool kpu_pass_start,
     bool cu_classification_done,
     int cu_class_number,
+    ap_uint<16> fetched_beats,
     bool &kpu_start,
     bool &prefetch_active,
     bool &compute_active,
     LayerConfig &current_config,
+    ActivationRoute &act_route,
+    DMARequest &dma_req,
     bool &done,
     bool &interrupt,
     int &final_class,
@@ -222,6 +558,7 @@ void iec_controller(
     #pragma HLS PIPELINE II=1
     #pragma HLS INTERFACE s_axilite port=layer_configs
     #pragma HLS INTERFACE s_axilite port=num_layers
+    #pragma HLS INTERFACE s_axilite port=batch_size
     #pragma HLS INTERFACE s_axilite port=start
     #pragma HLS INTERFACE s_axilite port=return
     
@@ -231,14 +568,19 @@ void iec_controller(
     iec.control(
         layer_configs,
         num_layers,
+        batch_size,
         start,
         kpu_done,
+        kpu_pass_start,
         cu_classification_done,
         cu_class_number,
+        fetched_beats,
         kpu_start,
         prefetch_active,
         compute_active,
         current_config,
+        act_route,
+        dma_req,
         done,
         interrupt,
         final_class,
@@ -26,8 +26,45 @@ private:
     ap_uint<16> iterations_per_layer;
     
     // Data tracking for pre-fetch logic
-    ap_uint<16> data_fetched;      // j in algorithm
-    ap_uint<16> data_required;     // rl in algorithm
+    ap_uint<32> data_fetched;      // j in algorithm
+    ap_uint<32> data_required;     // rl in algorithm
+    
+    // Burst fetch tracking (m_axi mode)
+    ap_uint<16> fetch_iteration;        // Iteration whose input is being fetched
+    ap_uint<32> beats_per_iteration;    // Input beats per iteration
+    ap_uint<32> beats_requested;        // Input beats requested for fetch_iteration
+    ap_uint<16> burst_wait;             // Cycles until the last burst has drained
+    ap_uint<16> weight_groups_requested;// Filter groups requested so far
+    ap_uint<32> weight_group_beats;     // Weight beats per filter group
+    ap_uint<32> weight_beats_requested; // FC streaming: weight beats requested
+    ap_uint<16> weight_burst_wait;      // FC streaming: cycles until drained
+    
+    // Batch loop: layer l runs every filter group over all batch_size
+    // images (group-major) before layer l+1 starts
+    ap_uint<8> batch_size;
+    ap_uint<8> fetch_image;             // Image whose input is being fetched
+    ap_uint<3> fetch_offset;            // FC streaming: image within the chunk
+    ap_uint<8> weight_image;            // FC streaming: first image of the weight pass
+    ap_uint<16> out_group;              // Filter group being written back
+    ap_uint<8> out_image;               // Image being written back
+    ap_uint<32> out_group_beats;        // Output beats per filter group
+    
+    // Grouped convolution: input channel slice being fetched
+    ap_uint<16> group_iterations;       // Filter groups per conv group
+    ap_uint<16> fetch_group;            // Conv group of fetch_iteration
+    ap_uint<16> fetch_group_iter;       // Filter group within fetch_group
+    
+    // Activation routing of the current layer and where the previous
+    // layer left its output
+    ActivationRoute route;
+    bool prev_dst_on_chip;
+    ap_uint<1> prev_dst_bank;
+    
+    // Issue the next input / weight bursts of the pre-fetch algorithm
+    void request_bursts(const LayerConfig &config, DMARequest &dma_req);
+    
+    // Move the input fetch on to the following iteration
+    void next_fetch_iteration();
     
     // Classification tracking
     int classification_result;
@@ -40,14 +77,19 @@ public:
     void control(
         LayerConfig layer_configs[MAX_LAYERS],
         int num_layers,
+        ap_uint<8> batch,
         bool start,
         bool kpu_done,
+        bool kpu_pass_start,
         bool cu_classification_done,
         int cu_class_number,
+        ap_uint<16> fetched_beats,
         bool &kpu_start,
         bool &prefetch_active,
         bool &compute_active,
         LayerConfig &current_config,
+        ActivationRoute &act_route,
+        DMARequest &dma_req,
         bool &done,
         bool &interrupt,
         int &final_class,
@@ -67,18 +109,25 @@ void iec_controller(
     // Layer configurations
     LayerConfig layer_configs[MAX_LAYERS],
     int num_layers,
+    ap_uint<8> batch_size,          // Images per batch (0 is treated as 1)
     
     // Control signals
     bool start,
     bool kpu_done,
+    bool kpu_pass_start,            // KPU moved to its next (group, image) pass
     bool cu_classification_done,
     int cu_class_number,
+    ap_uint<16> fetched_beats,      // Input beats delivered last cycle
     
     // Outputs to KPU
     bool &kpu_start,
     bool &prefetch_active,
     bool &compute_active,
     LayerConfig &current_config,
+    ActivationRoute &act_route,     // Activation buffer source/destination
+    
+    // Burst requests to the DDR master (m_axi mode)
+    DMARequest &dma_req,
     
     // Status outputs
     bool &done,
@@ -20,6 +20,36 @@ KPCController::KPCController() {
     data_required = 0;
     h_stride_count = 0;
     v_stride_count = 0;
+    load_col = 0;
+    load_addr = 0;
+    weights_per_filter = 0;
+    compute_bank = 0;
+    load_bank = 1;
+    loading = false;
+    bank_ready = false;
+    groups_loaded = 0;
+    bias_idx = 0;
+    first_window = false;
+    tap_row = 0;
+    tap_col = 0;
+    dw_rows = 1;
+    pointwise = false;
+    pw_count = 0;
+    pixels_done = 0;
+    weight_stationary = false;
+    load_row = 0;
+    ws_rows = 1;
+    fc_stream = false;
+    fc_inputs = 0;
+    fc_k = 0;
+    fc_beat = 0;
+    weightless = false;
+    beat_stream = false;
+    stream_beats = 0;
+    stream_total = 0;
+    batch_size = 1;
+    image_count = 0;
+    new_pass = false;
 }
 
 void KPCController::reset() {
@@ -31,20 +61,170 @@ void KPCController::reset() {
     iteration_count = 0;
     h_stride_count = 0;
     v_stride_count = 0;
+    load_col = 0;
+    load_addr = 0;
+    loading = false;
+    bank_ready = false;
+    bias_idx = 0;
+    first_window = false;
+    tap_row = 0;
+    tap_col = 0;
+    dw_rows = 1;
+    pointwise = false;
+    pw_count = 0;
+    pixels_done = 0;
+    weight_stationary = false;
+    load_row = 0;
+    ws_rows = 1;
+    fc_stream = false;
+    fc_inputs = 0;
+    fc_k = 0;
+    fc_beat = 0;
+    weightless = false;
+    beat_stream = false;
+    stream_beats = 0;
+    stream_total = 0;
+    batch_size = 1;
+    image_count = 0;
+    new_pass = false;
 }
 
-void KPCController::configure(LayerConfig &config) {
+void KPCController::configure(LayerConfig &config, ap_uint<8> batch) {
     #pragma HLS INLINE
     
     total_iterations = config.nl;
     data_required = config.rl;
     data_fetched = 0;
     iteration_count = 0;
-    current_state = KPC_PREFETCH;
+    
+    batch_size = (batch == 0) ? (ap_uint<8>)1 : batch;
+    image_count = 0;
+    new_pass = false;
+    
+    // Weights held by each PE for one output; the IEC rejects filters that
+    // do not fit the weight memory (LAYER_UNSUPPORTED)
+    weights_per_filter = PE_FILTER_SIZE(config);
+    
+    // Load the first filter group into the idle bank; the KPC waits for it
+    // before pre-fetching input data
+    load_col = 0;
+    load_row = 0;
+    load_addr = 0;
+    load_bank = ~compute_bank;
+    loading = true;
+    bank_ready = false;
+    groups_loaded = 1;
+    current_state = KPC_LOAD_WEIGHTS;
+    
+    // Depthwise: PE row i computes output row i of a band; the band's
+    // windows must fit in the M_SIZE line memories
+    tap_row = 0;
+    tap_col = 0;
+    dw_rows = (config.kernel_h <= M_SIZE) ?
+              (ap_uint<4>)((M_SIZE - config.kernel_h) / config.stride + 1) : (ap_uint<4>)1;
+    
+    pointwise = IS_POINTWISE(config);
+    pw_count = 0;
+    pixels_done = 0;
+    
+    // Weight-stationary: as many kh-row groups as fit in the PE rows
+    weight_stationary = IS_WEIGHT_STATIONARY(config);
+    ws_rows = weight_stationary ? (ap_uint<4>)(M_SIZE / config.kernel_h) : (ap_uint<4>)1;
+    
+    // FC layers never use the weight memories: skip the load phases and
+    // stream straight into the MACs
+    fc_stream = (config.layer_type == FC);
+    fc_inputs = config.input_h * config.input_w * config.input_c;
+    fc_k = 0;
+    fc_beat = 0;
+    if (fc_stream) {
+        loading = false;
+        current_state = KPC_COMPUTE;
+    }
+    
+    // Pooling windows need no weights: pre-fetch right away. Global pooling
+    // and element-wise adds consume the input beat by beat, nl channel
+    // groups of whole maps
+    weightless = IS_WEIGHTLESS(config);
+    beat_stream = (config.layer_type == GAVGPOOL || config.layer_type == ELTWISE_ADD);
+    stream_beats = 0;
+    stream_total = config.input_h * config.input_c *
+                   ((config.input_w + AXIS_LANES - 1) / AXIS_LANES) / config.nl;
+    if (weightless) {
+        loading = false;
+        current_state = beat_stream ? KPC_COMPUTE : KPC_PREFETCH;
+    }
+}
+
+void KPCController::finish_iteration() {
+    #pragma HLS INLINE
+    
+    // An FC pass streams its neuron group once for a chunk of up to
+    // FC_BATCH_MAX images, which the PE array applies every weight beat to
+    ap_uint<9> next_image = image_count + (fc_stream ? FC_BATCH_MAX : 1);
+    
+    if (next_image < batch_size) {
+        // Next image of the batch runs against the resident filter group:
+        // weights and biases stay put, only the input is fetched again
+        image_count = next_image;
+        data_fetched = 0;
+        new_pass = true;
+        current_state = (fc_stream || beat_stream) ? KPC_COMPUTE : KPC_PREFETCH;
+    } else {
+        image_count = 0;
+        iteration_count++;
+        
+        // Check if all iterations complete
+        if (iteration_count >= total_iterations) {
+            current_state = KPC_DONE;
+        } else if (fc_stream || beat_stream) {
+            // Next neuron/channel group streams in right away
+            new_pass = true;
+            current_state = KPC_COMPUTE;
+        } else if (weightless) {
+            // Next channel group: nothing to load
+            data_fetched = 0;
+            new_pass = true;
+            current_state = KPC_PREFETCH;
+        } else {
+            // Switch to the pre-loaded filter group; only stall if its
+            // weights have not fully arrived yet
+            data_fetched = 0;
+            new_pass = true;
+            if (bank_ready) {
+                swap_weight_banks();
+                bias_idx = 0;
+                current_state = KPC_LOAD_BIAS;
+            } else {
+                current_state = KPC_LOAD_WEIGHTS;
+            }
+        }
+    }
+}
+
+void KPCController::swap_weight_banks() {
+    #pragma HLS INLINE
+    
+    compute_bank = load_bank;
+    load_bank = ~load_bank;
+    bank_ready = false;
+    
+    // Pre-load the next filter group while this one is computed
+    if (groups_loaded < total_iterations) {
+        load_col = 0;
+        load_row = 0;
+        load_addr = 0;
+        loading = true;
+        groups_loaded++;
+    }
 }
 
 void KPCController::control(
     LayerConfig &config,
+    bool weight_ack,
+    bool bias_ack,
+    bool input_ack,
+    bool data_ready,
     bool stride_requests[M_SIZE][N_SIZE],
     ap_uint<5> line_selection[M_SIZE][N_SIZE],
     bool read_enable[M_SIZE],
@@ -52,8 +232,22 @@ void KPCController::control(
     bool reuse_mode[M_SIZE],
     addr_t ra_r[M_SIZE],
     addr_t ra_n[M_SIZE],
+    bool pad_row[M_SIZE],
+    bool row_enable[M_SIZE],
+    bool &weight_load,
+    ap_uint<5> &weight_load_col,
+    ap_uint<4> &weight_load_row,
+    addr_t &weight_load_addr,
+    idx_t &weight_load_lanes,
+    ap_uint<1> &weight_load_bank,
+    ap_uint<1> &weight_bank,
+    bool &bias_load,
+    ap_uint<5> &bias_load_idx,
     bool &next_stride,
     bool &compute_enable,
+    bool &acc_reset,
+    bool &fc_bias_row,
+    bool &pass_start,
     bool &layer_done
 ) {
     #pragma HLS PIPELINE II=1
@@ -62,12 +256,100 @@ void KPCController::control(
     #pragma HLS ARRAY_PARTITION variable=read_enable complete
     #pragma HLS ARRAY_PARTITION variable=write_enable complete
     #pragma HLS ARRAY_PARTITION variable=reuse_mode complete
+    #pragma HLS ARRAY_PARTITION variable=pad_row complete
+    #pragma HLS ARRAY_PARTITION variable=row_enable complete
     
     // Default outputs
+    bias_load = false;
     next_stride = false;
     compute_enable = false;
+    acc_reset = false;
+    fc_bias_row = false;
     layer_done = false;
     
+    // Pass boundaries are reported one cycle after the pass was set up
+    pass_start = new_pass;
+    new_pass = false;
+    
+    for (int i = 0; i < M_SIZE; i++) {
+        #pragma HLS UNROLL
+        pad_row[i] = false;
+        row_enable[i] = true;
+    }
+    
+    // Each filter occupies whole beats; the last beat of a filter is only
+    // partially valid
+    addr_t remaining = weights_per_filter - load_addr;
+    
+    // Weight loading runs alongside every state: one beat per cycle into the
+    // idle bank. The ack is for the beat driven in the previous cycle, so
+    // step past it before driving the next one
+    if (loading) {
+        if (weight_ack) {
+            if (remaining <= AXIS_LANES) {
+                load_addr = 0;
+                
+                // Weight-stationary filters arrive kernel row by kernel row,
+                // each row starting on a fresh beat
+                load_row++;
+                if (!weight_stationary || load_row == config.kernel_h) {
+                    load_row = 0;
+                    load_col++;
+                }
+                
+                if (load_col == N_SIZE) {
+                    load_col = 0;
+                    loading = false;
+                    bank_ready = true;
+                }
+            } else {
+                load_addr += AXIS_LANES;
+            }
+        }
+    }
+    
+    // Bias, FC weight and streamed input beats are acknowledged the same way
+    if (current_state == KPC_LOAD_BIAS && bias_ack) {
+        if (bias_idx == N_SIZE - 1) {
+            bias_idx = 0;
+            current_state = KPC_PREFETCH;
+        } else {
+            bias_idx++;
+        }
+    }
+    
+    if (current_state == KPC_COMPUTE && fc_stream && weight_ack) {
+        fc_beat++;
+        if (fc_beat == FC_BEATS_PER_INPUT) {
+            fc_beat = 0;
+            fc_k++;
+            
+            if (fc_k > fc_inputs) {
+                fc_k = 0;
+                finish_iteration();
+            }
+        }
+    }
+    
+    if (current_state == KPC_COMPUTE && beat_stream && input_ack) {
+        stream_beats++;
+        if (stream_beats == stream_total) {
+            stream_beats = 0;
+            finish_iteration();
+        }
+    }
+    
+    weight_load = loading;
+    weight_load_col = load_col;
+    weight_load_row = load_row;
+    weight_load_addr = load_addr;
+    weight_load_bank = load_bank;
+    weight_bank = compute_bank;
+    bias_load_idx = bias_idx;
+    
+    remaining = weights_per_filter - load_addr;
+    weight_load_lanes = (remaining < AXIS_LANES) ? (idx_t)remaining : (idx_t)AXIS_LANES;
+    
     // FSM State Machine
     switch (current_state) {
         
@@ -80,6 +362,35 @@ void KPCController::control(
             }
             break;
             
+        case KPC_LOAD_WEIGHTS:
+            // Stall until the next filter group is resident in the idle bank
+            // (all M_SIZE PEs of column load_col share filter load_col)
+            for (int i = 0; i < M_SIZE; i++) {
+                #pragma HLS UNROLL
+                read_enable[i] = false;
+                write_enable[i] = false;
+            }
+            
+            if (bank_ready) {
+                swap_weight_banks();
+                bias_idx = 0;
+                current_state = KPC_LOAD_BIAS;
+            }
+            break;
+            
+        case KPC_LOAD_BIAS:
+            // Short burst of N_SIZE biases (one per filter column) into the
+            // PE array's bias register file at the start of each iteration
+            bias_load = true;
+            
+            for (int i = 0; i < M_SIZE; i++) {
+                #pragma HLS UNROLL
+                read_enable[i] = false;
+                write_enable[i] = false;
+            }
+            
+            break;
+            
         case KPC_PREFETCH:
             // Pre-fetch rl data items before starting computation
             // Enable writing to line memories
@@ -93,6 +404,7 @@ void KPCController::control(
             
             // Check if we have enough data
             if (data_fetched >= data_required) {
+                first_window = true;
                 current_state = KPC_COMPUTE;
             }
             break;
@@ -101,6 +413,10 @@ void KPCController::control(
             // Enable computation
             compute_enable = true;
             
+            // Accumulators of the first window start from the bias registers
+            acc_reset = first_window;
+            first_window = false;
+            
             // Continue fetching remaining data while computing
             for (int i = 0; i < M_SIZE; i++) {
                 #pragma HLS UNROLL
@@ -108,16 +424,161 @@ void KPCController::control(
                 read_enable[i] = true;   // Enable reading for PEs
             }
             
-            // Generate line selection for each PE
-            // Each PE in column j reads from line memory (current_row + PE_row) % M_SIZE
-            for (int i = 0; i < M_SIZE; i++) {
-                #pragma HLS UNROLL
-                for (int j = 0; j < N_SIZE; j++) {
+            if (fc_stream) {
+                // FC streaming: beat fc_beat carries the weights of PEs
+                // fc_beat*AXIS_LANES onwards for input element fc_k; the
+                // element is broadcast to all of them. The first element
+                // starts the accumulators, the bias row completes them
+                ap_uint<8> first_pe = fc_beat * AXIS_LANES;
+                
+                weight_load = true;
+                weight_load_col = fc_beat;
+                weight_load_lanes = (TOTAL_PES - first_pe < AXIS_LANES) ?
+                                    (idx_t)(TOTAL_PES - first_pe) : (idx_t)AXIS_LANES;
+                acc_reset = (fc_k == 0);
+                fc_bias_row = (fc_k == fc_inputs);
+                break;
+            }
+            
+            if (beat_stream) {
+                // Global pooling / element-wise add: the PE array consumes
+                // each input beat as it arrives; line memories are bypassed
+                for (int i = 0; i < M_SIZE; i++) {
+                    #pragma HLS UNROLL
+                    write_enable[i] = false;
+                    read_enable[i] = false;
+                }
+                break;
+            }
+            
+            if (pointwise) {
+                // Pointwise GEMM: PE row i takes pixel i of the current block
+                // (stored in bank i), column j filter j; one channel per
+                // cycle and the PEs restart back to back, so every cycle
+                // is a MAC cycle. The first cycle of a pass only loads the
+                // biases; a block starts once all its pixels are resident
+                ap_uint<20> total_pixels = config.input_h * config.input_w;
+                bool issue = !acc_reset && (pw_count != 0 || data_ready);
+                
+                compute_enable = acc_reset || issue;
+                
+                for (int i = 0; i < M_SIZE; i++) {
+                    #pragma HLS UNROLL
+                    
+                    for (int j = 0; j < N_SIZE; j++) {
+                        #pragma HLS UNROLL
+                        line_selection[i][j] = i;
+                    }
+                    
+                    reuse_mode[i] = false;
+                    read_enable[i] = issue;
+                    row_enable[i] = (pixels_done + i < total_pixels);
+                }
+                
+                if (issue) {
+                    pw_count++;
+                    if (pw_count == weights_per_filter) {
+                        pw_count = 0;
+                        pixels_done += M_SIZE;
+                        
+                        if (pixels_done >= total_pixels) {
+                            pixels_done = 0;
+                            finish_iteration();
+                        }
+                    }
+                }
+                break;
+            }
+            
+            if (IS_CHANNEL_WISE(config)) {
+                // Depthwise and pooling: column j holds channel j, so every
+                // PE walks its own kh × kw window, one tap per cycle; PE row
+                // i reads kernel row tap_row of output row i of the band
+                // from the matching line memory, at the tap's column. The
+                // PEs restart by themselves after each window. The first
+                // cycle of a pass only starts the accumulators; a band
+                // starts once its rows are resident and its output buffer
+                // is free
+                ap_uint<11> row_end = config.input_h + 2 * config.padding - config.kernel_h + 1;
+                bool issue = !acc_reset && (tap_row != 0 || tap_col != 0 || data_ready);
+                
+                compute_enable = acc_reset || issue;
+                
+                for (int i = 0; i < M_SIZE; i++) {
+                    #pragma HLS UNROLL
+                    
+                    ap_uint<11> padded_row = current_row + i * config.stride + tap_row;
+                    ap_uint<5> line_idx = (padded_row - config.padding) % M_SIZE;
+                    
+                    for (int j = 0; j < N_SIZE; j++) {
+                        #pragma HLS UNROLL
+                        line_selection[i][j] = line_idx;
+                    }
+                    
+                    pad_row[i] = (padded_row < config.padding) ||
+                                 (padded_row >= config.input_h + config.padding);
+                    row_enable[i] = (i < dw_rows) && (current_row + i * config.stride < row_end);
+                    reuse_mode[i] = false;
+                    ra_n[i] = current_col + tap_col;
+                    read_enable[i] = issue;
+                }
+                next_stride = issue;
+                
+                if (issue) {
+                    tap_col++;
+                    if (tap_col == config.kernel_w) {
+                        tap_col = 0;
+                        tap_row++;
+                        
+                        // Window complete: every PE produced its output
+                        if (tap_row == config.kernel_h) {
+                            tap_row = 0;
+                            current_state = KPC_STRIDE_H;
+                        }
+                    }
+                }
+                break;
+            }
+            
+            if (weight_stationary) {
+                // Weight-stationary: PE row i applies kernel row i % kh to
+                // output row i / kh of the band; rows beyond the last full
+                // group stay idle
+                for (int i = 0; i < M_SIZE; i++) {
+                    #pragma HLS UNROLL
+                    
+                    ap_uint<11> padded_row = current_row + (i / config.kernel_h) * config.stride +
+                                             i % config.kernel_h;
+                    ap_uint<5> line_idx = (padded_row - config.padding) % M_SIZE;
+                    
+                    for (int j = 0; j < N_SIZE; j++) {
+                        #pragma HLS UNROLL
+                        line_selection[i][j] = line_idx;
+                    }
+                    
+                    pad_row[i] = (padded_row < config.padding) ||
+                                 (padded_row >= config.input_h + config.padding);
+                    row_enable[i] = (i < ws_rows * config.kernel_h);
+                }
+            } else {
+                // Generate line selection for each PE
+                // Each PE in column j reads from line memory (current_row + PE_row) % M_SIZE
+                for (int i = 0; i < M_SIZE; i++) {
                     #pragma HLS UNROLL
                     
                     // Line selection based on kernel position
                     ap_uint<5> line_idx = (i + (current_row % config.kernel_h)) % M_SIZE;
-                    line_selection[i][j] = line_idx;
+                    
+                    for (int j = 0; j < N_SIZE; j++) {
+                        #pragma HLS UNROLL
+                        line_selection[i][j] = line_idx;
+                    }
+                    
+                    // current_row counts padded rows: kernel row i falls in the
+                    // top/bottom padding when it is outside the stored rows
+                    ap_uint<11> padded_row = current_row + i;
+                    pad_row[i] = (padded_row < config.padding) ||
+                                 (padded_row >= config.input_h + config.padding);
                 }
             }
             
@@ -146,16 +607,18 @@ void KPCController::control(
             current_col += config.stride;
             h_stride_count++;
             
-            // Check if we reached end of row
-            if (current_col >= (config.input_w - config.kernel_w + 1)) {
+            // Check if we reached end of row (columns include the padding,
+            // which the line memories synthesize on read)
+            if (current_col >= (config.input_w + 2 * config.padding - config.kernel_w + 1)) {
                 current_col = 0;
                 current_state = KPC_STRIDE_V;
             } else {
                 // Determine reuse mode
-                // If stride < kernel_w, we reuse data
+                // If stride < kernel_w, we reuse data (depthwise windows
+                // always restart from their first column)
                 for (int i = 0; i < M_SIZE; i++) {
                     #pragma HLS UNROLL
-                    if (config.stride < config.kernel_w) {
+                    if (config.stride < config.kernel_w && !IS_CHANNEL_WISE(config)) {
                         reuse_mode[i] = true;
                         // Set reuse addresses
                         ra_r[i] = current_col;
@@ -174,27 +637,29 @@ void KPCController::control(
             // Vertical stride: Move to next set of line memories
             next_stride = true;
             
-            current_row += config.stride;
+            // Depthwise bands cover dw_rows output rows, weight-stationary
+            // groups ws_rows rows
+            if (weight_stationary) {
+                current_row += ws_rows * config.stride;
+            } else {
+                current_row += IS_CHANNEL_WISE(config) ?
+                               (ap_uint<10>)(dw_rows * config.stride) : (ap_uint<10>)config.stride;
+            }
             v_stride_count++;
             
-            // Check if we completed one iteration
-            if (current_row >= (config.input_h - config.kernel_h + 1)) {
+            // Check if we completed one iteration (padded rows, as above)
+            if (current_row >= (config.input_h + 2 * config.padding - config.kernel_h + 1)) {
                 current_row = 0;
-                iteration_count++;
-                
-                // Check if all iterations complete
-                if (iteration_count >= total_iterations) {
-                    current_state = KPC_DONE;
-                } else {
-                    // Start pre-fetch for next iteration
-                    data_fetched = 0;
-                    current_state = KPC_PREFETCH;
-                }
+                finish_iteration();
             } else {
-                // Reuse line memories if vertical stride allows
+                // Reuse line memories if vertical stride allows; depthwise
+                // bands restart from the first column of the new rows
                 for (int i = 0; i < M_SIZE; i++) {
                     #pragma HLS UNROLL
-                    if (config.stride < config.kernel_h) {
+                    if (IS_CHANNEL_WISE(config)) {
+                        reuse_mode[i] = false;
+                        ra_n[i] = 0;
+                    } else if (config.stride < config.kernel_h) {
                         reuse_mode[i] = true;
                     } else {
                         reuse_mode[i] = false;
@@ -225,7 +690,12 @@ void KPCController::control(
 
 void kpc_controller(
     LayerConfig config,
+    ap_uint<8> batch_size,
     bool start,
+    bool weight_ack,
+    bool bias_ack,
+    bool input_ack,
+    bool data_ready,
     bool stride_requests[M_SIZE][N_SIZE],
     ap_uint<5> line_selection[M_SIZE][N_SIZE],
     bool read_enable[M_SIZE],
@@ -233,8 +703,22 @@ void kpc_controller(
     bool reuse_mode[M_SIZE],
     addr_t ra_r[M_SIZE],
     addr_t ra_n[M_SIZE],
+    bool pad_row[M_SIZE],
+    bool row_enable[M_SIZE],
+    bool &weight_load,
+    ap_uint<5> &weight_load_col,
+    ap_uint<4> &weight_load_row,
+    addr_t &weight_load_addr,
+    idx_t &weight_load_lanes,
+    ap_uint<1> &weight_load_bank,
+    ap_uint<1> &weight_bank,
+    bool &bias_load,
+    ap_uint<5> &bias_load_idx,
     bool &next_stride,
     bool &compute_enable,
+    bool &acc_reset,
+    bool &fc_bias_row,
+    bool &pass_start,
     bool &done
 ) {
     #pragma HLS INLINE off
@@ -246,16 +730,22 @@ void kpc_controller(
     #pragma HLS ARRAY_PARTITION variable=reuse_mode complete
     #pragma HLS ARRAY_PARTITION variable=ra_r complete
     #pragma HLS ARRAY_PARTITION variable=ra_n complete
+    #pragma HLS ARRAY_PARTITION variable=pad_row complete
+    #pragma HLS ARRAY_PARTITION variable=row_enable complete
     
     static KPCController kpc;
     #pragma HLS RESET variable=kpc
     
     if (start) {
-        kpc.configure(config);
+        kpc.configure(config, batch_size);
     }
     
     kpc.control(
         config,
+        weight_ack,
+        bias_ack,
+        input_ack,
+        data_ready,
         stride_requests,
         line_selection,
         read_enable,
@@ -263,8 +753,22 @@ void kpc_controller(
         reuse_mode,
         ra_r,
         ra_n,
+        pad_row,
+        row_enable,
+        weight_load,
+        weight_load_col,
+        weight_load_row,
+        weight_load_addr,
+        weight_load_lanes,
+        weight_load_bank,
+        weight_bank,
+        bias_load,
+        bias_load_idx,
         next_stride,
         compute_enable,
+        acc_reset,
+        fc_bias_row,
+        pass_start,
         done
     );
 }
@@ -33,12 +33,79 @@ private:
     ap_uint<10> h_stride_count;
     ap_uint<10> v_stride_count;
     
+    // Weight load control (one packed weight beat per cycle)
+    ap_uint<5> load_col;            // PE column being loaded
+    addr_t load_addr;               // Weight memory address being loaded
+    addr_t weights_per_filter;      // kernel_h × kernel_w × kernel_d
+    
+    // Ping-pong weight banks
+    ap_uint<1> compute_bank;        // Bank feeding the MACs
+    ap_uint<1> load_bank;           // Bank being (pre-)loaded
+    bool loading;                   // Load in progress (runs in background)
+    bool bank_ready;                // load_bank holds the next filter group
+    ap_uint<16> groups_loaded;      // Filter groups loaded so far this layer
+    
+    // Make the pre-loaded bank active and pre-load the following group
+    void swap_weight_banks();
+    
+    // Advance to the next iteration (filter group) or finish the layer
+    void finish_iteration();
+    
+    // Bias register file load (N_SIZE beats per iteration)
+    ap_uint<5> bias_idx;            // Bias register being loaded
+    
+    // First window of an iteration: accumulators start from the bias
+    bool first_window;
+    
+    // Depthwise (DWCONV) window walk: each PE runs its own kh × kw taps
+    ap_uint<4> tap_row;             // Kernel row of the current tap
+    ap_uint<4> tap_col;             // Kernel column of the current tap
+    ap_uint<4> dw_rows;             // Output rows per vertical step
+    
+    // Pointwise (1×1) GEMM mode: M_SIZE pixels × N_SIZE filters per block,
+    // one input channel per cycle, no window/stride states
+    bool pointwise;
+    ap_uint<16> pw_count;           // Channels consumed for the current block
+    ap_uint<20> pixels_done;        // Pixels finished in this iteration
+    
+    // Weight-stationary mode: PE row i keeps kernel row i % kh of its
+    // column's filter; groups of kh rows cover ws_rows output rows
+    bool weight_stationary;
+    ap_uint<4> load_row;            // Kernel row being loaded
+    ap_uint<4> ws_rows;             // Output rows per vertical step
+    
+    // FC streaming mode: weights go straight from the stream to the MACs,
+    // FC_BEATS_PER_INPUT beats (one weight per PE) per input element,
+    // followed by one row of biases
+    bool fc_stream;
+    ap_uint<20> fc_inputs;          // Input elements per neuron
+    ap_uint<20> fc_k;               // Input element being applied
+    ap_uint<5> fc_beat;             // Weight beat within the element
+    
+    // Pooling and element-wise layers have no weights or biases; global
+    // pooling and ELTWISE_ADD consume input beats as they arrive, bypassing
+    // the line memories
+    bool weightless;
+    bool beat_stream;
+    ap_uint<20> stream_beats;       // Input beats consumed this iteration
+    ap_uint<20> stream_total;       // Input beats per iteration
+    
+    // Batch loop: every filter group is applied to all batch_size images
+    // before the next group is swapped in
+    ap_uint<8> batch_size;
+    ap_uint<8> image_count;         // Images finished with the current group
+    bool new_pass;                  // A (group, image) pass was just started
+    
 public:
     KPCController();
     
     // Main control function
     void control(
         LayerConfig &config,
+        bool weight_ack,
+        bool bias_ack,
+        bool input_ack,
+        bool data_ready,
         bool stride_requests[M_SIZE][N_SIZE],
         ap_uint<5> line_selection[M_SIZE][N_SIZE],
         bool read_enable[M_SIZE],
@@ -46,8 +113,22 @@ public:
         bool reuse_mode[M_SIZE],
         addr_t ra_r[M_SIZE],
         addr_t ra_n[M_SIZE],
+        bool pad_row[M_SIZE],
+        bool row_enable[M_SIZE],
+        bool &weight_load,
+        ap_uint<5> &weight_load_col,
+        ap_uint<4> &weight_load_row,
+        addr_t &weight_load_addr,
+        idx_t &weight_load_lanes,
+        ap_uint<1> &weight_load_bank,
+        ap_uint<1> &weight_bank,
+        bool &bias_load,
+        ap_uint<5> &bias_load_idx,
         bool &next_stride,
         bool &compute_enable,
+        bool &acc_reset,
+        bool &fc_bias_row,
+        bool &pass_start,
         bool &layer_done
     );
     
@@ -55,7 +136,7 @@ public:
     void reset();
     
     // Configure for new layer
-    void configure(LayerConfig &config);
+    void configure(LayerConfig &config, ap_uint<8> batch);
 };
 
 /******************************************************************************
@@ -64,7 +145,12 @@ public:
 
 void kpc_controller(
     LayerConfig config,
+    ap_uint<8> batch_size,          // Images per batch (weights stay resident)
     bool start,
+    bool weight_ack,                // Weight beat consumed this cycle
+    bool bias_ack,                  // Bias beat consumed this cycle
+    bool input_ack,                 // Input beat consumed (beat-streaming layers)
+    bool data_ready,                // Pointwise block / depthwise band can start
     bool stride_requests[M_SIZE][N_SIZE],
     ap_uint<5> line_selection[M_SIZE][N_SIZE],
     bool read_enable[M_SIZE],
@@ -72,8 +158,22 @@ void kpc_controller(
     bool reuse_mode[M_SIZE],
     addr_t ra_r[M_SIZE],
     addr_t ra_n[M_SIZE],
+    bool pad_row[M_SIZE],
+    bool row_enable[M_SIZE],
+    bool &weight_load,              // Weight load phase active
+    ap_uint<5> &weight_load_col,    // PE column to load
+    ap_uint<4> &weight_load_row,    // Kernel row to load (weight-stationary)
+    addr_t &weight_load_addr,       // Weight memory address to load
+    idx_t &weight_load_lanes,       // Valid weights in the beat
+    ap_uint<1> &weight_load_bank,   // Weight bank being loaded
+    ap_uint<1> &weight_bank,        // Weight bank feeding the MACs
+    bool &bias_load,                // Bias load phase active
+    ap_uint<5> &bias_load_idx,      // Bias register to load
     bool &next_stride,
     bool &compute_enable,
+    bool &acc_reset,                // Start accumulators from bias
+    bool &fc_bias_row,              // FC streaming: bias row, outputs complete
+    bool &pass_start,               // Next (filter group, image) pass begins
     bool &done
 );
 
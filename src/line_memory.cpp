@@ -12,14 +12,15 @@
 
 LineMemory::LineMemory() {
     #pragma HLS ARRAY_PARTITION variable=output_buffer complete
+    #pragma HLS ARRAY_PARTITION variable=memory cyclic factor=AXIS_LANES
     #pragma HLS BIND_STORAGE variable=memory type=RAM_2P latency=1
     #pragma HLS RESOURCE variable=memory core=RAM_2P_BRAM
     
     write_ptr = 0;
-    read_ptr_new = 0;
-    read_ptr_reuse = 0;
     data_count = 0;
     ready_flag = false;
+    pad = 0;
+    row_width = LINE_MEM_WIDTH;
     
     // Initialize memory
     for (int i = 0; i < LINE_MEM_WIDTH; i++) {
@@ -52,6 +53,33 @@ void LineMemory::write_data(data_t data_in, bool write_enable) {
     }
 }
 
+void LineMemory::write_beat(const axis_beat_t &beat, idx_t lanes) {
+    #pragma HLS INLINE off
+    #pragma HLS PIPELINE II=1
+    
+    // Consecutive addresses fall in different cyclic partitions, so all
+    // lanes of a beat are written in the same cycle
+    for (int l = 0; l < AXIS_LANES; l++) {
+        #pragma HLS UNROLL
+        
+        if (l < lanes) {
+            addr_t addr = write_ptr + l;
+            if (addr >= LINE_MEM_WIDTH) {
+                addr = addr - LINE_MEM_WIDTH;  // Wrap around
+            }
+            memory[addr] = beat.lane[l];
+        }
+    }
+    
+    write_ptr += lanes;
+    if (write_ptr >= LINE_MEM_WIDTH) {
+        write_ptr -= LINE_MEM_WIDTH;
+    }
+    
+    // Track data count for pre-fetch monitoring
+    data_count += lanes;
+}
+
 void LineMemory::read_data(
     bool read_enable,
     bool reuse_mode,
@@ -67,29 +95,31 @@ void LineMemory::read_data(
     ready = (data_count >= required_count);
     
     if (read_enable) {
-        // Select read pointer based on reuse mode
-        addr_t read_ptr = reuse_mode ? read_ptr_reuse : read_ptr_new;
+        // Select read pointer based on reuse mode; the AGU advances the new
+        // data pointer past the windows of this read
+        addr_t read_ptr = reuse_mode ?
+                          read_agu.get_reuse_address(false, LINE_MEM_WIDTH) :
+                          read_agu.get_new_address(true, LINE_MEM_WIDTH);
         
-        // Read n consecutive values into output buffer
+        // Read n (padded) columns, one per window `stride` columns apart, into
+        // output buffer; columns in the left/right padding read as zero
+        // without being stored
         for (int i = 0; i < N_SIZE; i++) {
             #pragma HLS UNROLL
             
-            addr_t addr = read_ptr + i;
+            ap_uint<11> col = read_ptr + read_agu.lane_offset(i);
+            bool in_row = (col >= pad) && (col < pad + row_width);
+            
+            // Depthwise rows store N_SIZE channels per pixel, lane = channel
+            addr_t addr = (read_agu.get_lane_mode() == LANE_CHANNELS) ?
+                          (addr_t)((col - pad) * N_SIZE + i) : (addr_t)(col - pad);
             if (addr >= LINE_MEM_WIDTH) {
                 addr = addr - LINE_MEM_WIDTH;  // Wrap around
             }
             
-            output_buffer[i] = memory[addr];
+            output_buffer[i] = in_row ? memory[addr] : TO_FIXED(0);
             outputs[i] = output_buffer[i];
         }
-        
-        // Update read pointer for next access
-        if (!reuse_mode) {
-            read_ptr_new += N_SIZE;  // Advance by n for new data
-            if (read_ptr_new >= LINE_MEM_WIDTH) {
-                read_ptr_new = 0;
-            }
-        }
     } else {
         // Output current buffer contents
         for (int i = 0; i < N_SIZE; i++) {
@@ -103,17 +133,40 @@ void LineMemory::reset() {
     #pragma HLS INLINE
     
     write_ptr = 0;
-    read_ptr_new = 0;
-    read_ptr_reuse = 0;
+    read_agu.reset();
     data_count = 0;
     ready_flag = false;
 }
 
+void LineMemory::begin_row() {
+    #pragma HLS INLINE
+    
+    write_ptr = 0;
+}
+
 void LineMemory::set_read_pointers(addr_t ptr_new, addr_t ptr_reuse) {
     #pragma HLS INLINE
     
-    read_ptr_new = ptr_new;
-    read_ptr_reuse = ptr_reuse;
+    read_agu.set_addresses(ptr_new, ptr_reuse);
+}
+
+void LineMemory::set_padding(ap_uint<3> padding, ap_uint<10> width) {
+    #pragma HLS INLINE
+    
+    pad = padding;
+    row_width = width;
+}
+
+void LineMemory::set_stride(ap_uint<3> stride) {
+    #pragma HLS INLINE
+    
+    read_agu.set_stride(stride);
+}
+
+void LineMemory::set_lane_mode(lane_mode_t mode) {
+    #pragma HLS INLINE
+    
+    read_agu.set_lane_mode(mode);
 }
 
 /******************************************************************************
@@ -131,6 +184,7 @@ void line_memory(
     int ra_n,
     bool next_stride,
     int r,
+    ap_uint<3> stride,
     data_t O[N_SIZE],
     bool &ready
 ) {
@@ -147,8 +201,9 @@ void line_memory(
         lm.write_data(data_in, true);
     }
     
-    // Update read pointers
+    // Update read pointers and window spacing
     lm.set_read_pointers(ra_n, ra_r);
+    lm.set_stride(stride);
     
     // Read operation
     bool reuse_mode = (reuse_selector == 1);
@@ -194,63 +249,3 @@ public:
         addr = 0;
     }
 };
-
-// Read Address Generator (RAG)
-class ReadAGU {
-private:
-    addr_t addr_new;      // For new data
-    addr_t addr_reuse;    // For reused data
-    ap_uint<3> stride;
-    
-public:
-    ReadAGU() : addr_new(0), addr_reuse(0), stride(1) {}
-    
-    void set_stride(ap_uint<3> s) {
-        #pragma HLS INLINE
-        stride = s;
-    }
-    
-    addr_t get_new_address(bool increment, ap_uint<10> line_width) {
-        #pragma HLS INLINE
-        #pragma HLS PIPELINE II=1
-        
-        addr_t current = addr_new;
-        
-        if (increment) {
-            addr_new += stride;
-            if (addr_new >= line_width) {
-                addr_new = 0;
-            }
-        }
-        
-        return current;
-    }
-    
-    addr_t get_reuse_address(bool increment, ap_uint<10> line_width) {
-        #pragma HLS INLINE
-        #pragma HLS PIPELINE II=1
-        
-        addr_t current = addr_reuse;
-        
-        if (increment) {
-            addr_reuse += stride;
-            if (addr_reuse >= line_width) {
-                addr_reuse = 0;
-            }
-        }
-        
-        return current;
-    }
-    
-    void set_addresses(addr_t new_addr, addr_t reuse_addr) {
-        #pragma HLS INLINE
-        addr_new = new_addr;
-        addr_reuse = reuse_addr;
-    }
-    
-    void reset() {
-        #pragma HLS INLINE
-        addr_new = 0;
-        addr_reuse = 0;
-    }
-};
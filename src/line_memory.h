@@ -9,6 +9,105 @@
 
 #include "../include/cnn_types.h"
 
+/******************************************************************************
+ * READ ADDRESS GENERATION UNIT
+ ******************************************************************************/
+
+// What the N_SIZE outputs of one line-memory read hold
+typedef enum {
+    LANE_WINDOWS = 0,   // N_SIZE windows, `stride` columns apart (CONV)
+    LANE_CHANNELS = 1,  // N_SIZE interleaved channels of one pixel (DWCONV)
+    LANE_BROADCAST = 2  // One value to every column (pointwise GEMM)
+} lane_mode_t;
+
+// Read Address Generator (RAG): one read delivers the inputs of N_SIZE
+// horizontally adjacent windows, which lie `stride` columns apart. In the
+// channel and broadcast lane modes a read covers a single address and the
+// address steps by one per read (next tap / next channel)
+class ReadAGU {
+private:
+    addr_t addr_new;      // For new data
+    addr_t addr_reuse;    // For reused data
+    ap_uint<3> stride;
+    lane_mode_t lane_mode;
+    
+public:
+    ReadAGU() : addr_new(0), addr_reuse(0), stride(1), lane_mode(LANE_WINDOWS) {}
+    
+    void set_stride(ap_uint<3> s) {
+        #pragma HLS INLINE
+        stride = s;
+    }
+    
+    ap_uint<3> get_stride() {
+        #pragma HLS INLINE
+        return stride;
+    }
+    
+    void set_lane_mode(lane_mode_t mode) {
+        #pragma HLS INLINE
+        lane_mode = mode;
+    }
+    
+    lane_mode_t get_lane_mode() {
+        #pragma HLS INLINE
+        return lane_mode;
+    }
+    
+    // Column of output lane i relative to the read address
+    ap_uint<10> lane_offset(int i) {
+        #pragma HLS INLINE
+        return (lane_mode == LANE_WINDOWS) ? (ap_uint<10>)(i * stride) : (ap_uint<10>)0;
+    }
+    
+    addr_t get_new_address(bool increment, ap_uint<10> line_width) {
+        #pragma HLS INLINE
+        #pragma HLS PIPELINE II=1
+        
+        addr_t current = addr_new;
+        
+        // New data: skip past the N_SIZE windows just read (next tap or
+        // channel in the single-address modes)
+        if (increment) {
+            addr_new += (lane_mode == LANE_WINDOWS) ? (ap_uint<10>)(stride * N_SIZE) :
+                                                      (ap_uint<10>)1;
+            if (addr_new >= line_width) {
+                addr_new = 0;
+            }
+        }
+        
+        return current;
+    }
+    
+    addr_t get_reuse_address(bool increment, ap_uint<10> line_width) {
+        #pragma HLS INLINE
+        #pragma HLS PIPELINE II=1
+        
+        addr_t current = addr_reuse;
+        
+        if (increment) {
+            addr_reuse += stride;
+            if (addr_reuse >= line_width) {
+                addr_reuse = 0;
+            }
+        }
+        
+        return current;
+    }
+    
+    void set_addresses(addr_t new_addr, addr_t reuse_addr) {
+        #pragma HLS INLINE
+        addr_new = new_addr;
+        addr_reuse = reuse_addr;
+    }
+    
+    void reset() {
+        #pragma HLS INLINE
+        addr_new = 0;
+        addr_reuse = 0;
+    }
+};
+
 /******************************************************************************
  * LINE MEMORY CLASS
  ******************************************************************************/
@@ -23,8 +122,7 @@ private:
     
     // Address pointers
     addr_t write_ptr;
-    addr_t read_ptr_new;      // For new data
-    addr_t read_ptr_reuse;    // For reused data
+    ReadAGU read_agu;         // New/reuse read addresses, stride-aware
     
     // Data count for pre-fetch monitoring
     ap_uint<16> data_count;
@@ -32,12 +130,20 @@ private:
     // Ready signal
     bool ready_flag;
     
+    // Zero padding: read addresses are padded columns; the stored row
+    // (row_width values) starts at padded column pad
+    ap_uint<3> pad;
+    ap_uint<10> row_width;
+    
 public:
     LineMemory();
     
     // Write operation
     void write_data(data_t data_in, bool write_enable);
     
+    // Packed write: first `lanes` lanes of one stream beat in a single cycle
+    void write_beat(const axis_beat_t &beat, idx_t lanes);
+    
     // Read operation with reuse logic
     void read_data(
         bool read_enable,
@@ -50,12 +156,25 @@ public:
     // Reset line memory
     void reset();
     
+    // Start the next row at address 0 (depthwise rows are read by column)
+    void begin_row();
+    
     // Set read pointers
     void set_read_pointers(addr_t ptr_new, addr_t ptr_reuse);
+    
+    // Configure left/right zero padding for the current layer
+    void set_padding(ap_uint<3> padding, ap_uint<10> width);
+    
+    // Configure the convolution stride (window spacing between outputs)
+    void set_stride(ap_uint<3> stride);
+    
+    // Layout of a read's N_SIZE outputs (windows, channels or broadcast)
+    void set_lane_mode(lane_mode_t mode);
 };
 
 /******************************************************************************
  * STANDALONE LINE MEMORY FUNCTION
+ * Wraps a single bank for unit-level synthesis; pe_array() owns M_SIZE banks
  ******************************************************************************/
 
 void line_memory(
@@ -69,6 +188,7 @@ void line_memory(
     int ra_n,                       // New address pointer
     bool next_stride,               // Next stride signal
     int r,                          // Minimum data count for ready
+    ap_uint<3> stride,              // Convolution stride
     data_t O[N_SIZE],              // n parallel outputs
     bool &ready                     // Ready signal (enough data)
 );
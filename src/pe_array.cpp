@@ -6,24 +6,84 @@
 
 #include "pe_array.h"
 
+/******************************************************************************
+ * OUTPUT BEAT ROUTING
+ ******************************************************************************/
+
+// Zero the unused lanes of a packed output beat and send it to the on-chip
+// activation buffer or across the AXI boundary; a copy is kept in the skip
+// buffer when the layer output feeds a later residual add
+void emit_output_beat(
+    axis_beat_t &beat,
+    idx_t lanes,
+    ActivationRoute route,
+    ActivationBuffer &act_buffer,
+    SkipBuffer &skip_buffer,
+    hls::stream<axis_beat_t> &output_stream
+) {
+    #pragma HLS INLINE
+    
+    for (int l = 0; l < AXIS_LANES; l++) {
+        #pragma HLS UNROLL
+        if (l >= lanes) {
+            beat.lane[l] = 0;
+        }
+    }
+    
+    if (route.skip_save) {
+        skip_buffer.write_beat(beat);
+    }
+    
+    if (route.dst_on_chip) {
+        act_buffer.write_beat(beat);
+    } else if (!output_stream.full()) {
+        output_stream.write(beat);
+    }
+}
+
+// Activation at output collection: standalone RELU/RELU6 layers, fused
+// ReLU6, and the fused ReLU the PE leaves for later (after a residual add
+// or a weight-stationary column reduction)
+data_t output_activation(data_t value, const LayerConfig &config, bool deferred_relu) {
+    #pragma HLS INLINE
+    
+    if (config.layer_type == RELU) {
+        return relu_with_szd(value);
+    } else if (config.layer_type == RELU6 || config.activation == ACT_RELU6) {
+        return relu6_with_szd(value);
+    } else if (deferred_relu && config.activation == ACT_RELU) {
+        return relu_with_szd(value);
+    }
+    return value;
+}
+
 /******************************************************************************
  * PE ARRAY IMPLEMENTATION
  ******************************************************************************/
 
 void pe_array(
-    hls::stream<data_t> &input_stream,
-    hls::stream<data_t> &weight_stream,
+    hls::stream<axis_beat_t> &input_stream,
+    hls::stream<axis_beat_t> &weight_stream,
     hls::stream<data_t> &bias_stream,
-    hls::stream<data_t> &output_stream,
+    hls::stream<axis_beat_t> &output_stream,
     LayerConfig config,
+    ActivationRoute act_route,
+    ap_uint<8> batch_size,
     bool start,
     bool &done,
-    ap_uint<32> &cycle_count
+    bool &pass_start,
+    ap_uint<32> &cycle_count,
+    ap_uint<32> &skipped_macs
 ) {
     #pragma HLS INLINE off
     #pragma HLS DATAFLOW
     
-    // PE instances (m×n array)
+    // PE instances (m×n array): every PE owns its weight memory,
+    // accumulator and weight address counter
+    static PE pe_grid[M_SIZE][N_SIZE];
+    #pragma HLS ARRAY_PARTITION variable=pe_grid complete dim=0
+    
+    // PE outputs
     static data_t pe_outputs[M_SIZE][N_SIZE];
     #pragma HLS ARRAY_PARTITION variable=pe_outputs complete dim=0
     
@@ -33,13 +93,31 @@ void pe_array(
     static bool pe_stride_req[M_SIZE][N_SIZE];
     #pragma HLS ARRAY_PARTITION variable=pe_stride_req complete dim=0
     
-    // Line memory instances (m line memories)
+    static bool pe_skipped[M_SIZE][N_SIZE];
+    #pragma HLS ARRAY_PARTITION variable=pe_skipped complete dim=0
+    
+    // Bias register file: one bias per filter column, loaded per iteration
+    static data_t bias_regs[N_SIZE];
+    #pragma HLS ARRAY_PARTITION variable=bias_regs complete
+    
+    // Line memory instances (m independent banks, each with its own
+    // storage, read/write pointers and ready flag)
+    static LineMemory line_banks[M_SIZE];
+    #pragma HLS ARRAY_PARTITION variable=line_banks complete
+    
+    // Line memory outputs
     static data_t line_outputs[M_SIZE][N_SIZE];
     #pragma HLS ARRAY_PARTITION variable=line_outputs complete dim=0
     
     static bool line_ready[M_SIZE];
     #pragma HLS ARRAY_PARTITION variable=line_ready complete
     
+    // Global ping-pong activation buffer (intermediate feature maps)
+    static ActivationBuffer act_buffer;
+    
+    // Saved map for residual adds (kept across layers)
+    static SkipBuffer skip_buffer;
+    
     // Control signals from KPC
     static ap_uint<5> line_selection[M_SIZE][N_SIZE];
     #pragma HLS ARRAY_PARTITION variable=line_selection complete dim=0
@@ -59,53 +137,612 @@ void pe_array(
     static addr_t ra_n[M_SIZE];
     #pragma HLS ARRAY_PARTITION variable=ra_n complete
     
+    static bool pad_row[M_SIZE];
+    #pragma HLS ARRAY_PARTITION variable=pad_row complete
+    
+    static bool row_enable[M_SIZE];
+    #pragma HLS ARRAY_PARTITION variable=row_enable complete
+    
+    static bool weight_load;
+    static ap_uint<5> weight_load_col;
+    static ap_uint<4> weight_load_row;
+    static addr_t weight_load_addr;
+    static idx_t weight_load_lanes;
+    static ap_uint<1> weight_load_bank;
+    static ap_uint<1> weight_bank;
+    
+    static bool bias_load;
+    static ap_uint<5> bias_load_idx;
+    
     static bool next_stride;
     static bool compute_enable;
+    static bool acc_reset;
+    static bool fc_bias_row;
+    static bool kpc_pass_start;
     static bool kpc_done;
     
     // Cycle counter
     static ap_uint<32> cycles = 0;
     #pragma HLS RESET variable=cycles
     
+    // Zero-skip counter: PE MAC slots gated in the current layer
+    static ap_uint<32> skipped = 0;
+    #pragma HLS RESET variable=skipped
+    
+    // Input row currently being written and its column count
+    static ap_uint<5> write_line_idx = 0;
+    static row_count_t write_col = 0;
+    
+    // Pointwise: pixels of the pass written to the line memories and pixels
+    // whose block the PEs have completed. Each bank holds two pixel vectors
+    // (see PW_MAX_DEPTH), so the next block is written while the current
+    // one is computed
+    static ap_uint<20> pw_pixels_in = 0;
+    static ap_uint<20> pw_pixels_out = 0;
+    bool pointwise = IS_POINTWISE(config);
+    ap_uint<20> total_pixels = config.input_h * config.input_w;
+    
+    // Depthwise and pooling: rows of the pass written to the line memories,
+    // and the band being computed (its first padded input row, first output
+    // row and completed windows). A band spans at most M_SIZE stored rows,
+    // so the writer runs up to M_SIZE rows past the band's first row
+    static ap_uint<10> cw_rows_in = 0;
+    static ap_uint<11> cw_band_row = 0;
+    static ap_uint<10> cw_out_row = 0;
+    static ap_uint<10> cw_col = 0;
+    bool channel_wise = IS_CHANNEL_WISE(config);
+    ap_uint<4> cw_band_rows = (config.kernel_h <= M_SIZE) ?
+                              (ap_uint<4>)((M_SIZE - config.kernel_h) / config.stride + 1) :
+                              (ap_uint<4>)1;
+    ap_uint<10> conv_h = (config.input_h + 2 * config.padding - config.kernel_h) /
+                         config.stride + 1;
+    ap_uint<10> conv_w = (config.input_w + 2 * config.padding - config.kernel_w) /
+                         config.stride + 1;
+    
+    // Completed bands wait in a ping-pong pair of output buffers, one row
+    // of conv_w pixels × N_SIZE channels per PE row, and drain row by row
+    // while the next band computes
+    static data_t cw_rows[2][M_SIZE][LINE_MEM_WIDTH];
+    #pragma HLS ARRAY_PARTITION variable=cw_rows complete dim=1
+    #pragma HLS ARRAY_PARTITION variable=cw_rows complete dim=2
+    #pragma HLS ARRAY_PARTITION variable=cw_rows cyclic factor=N_SIZE dim=3
+    static ap_uint<4> cw_rows_held[2];
+    static bool cw_busy[2] = {false, false};
+    static ap_uint<1> cw_fill = 0;
+    static ap_uint<1> cw_drain = 0;
+    static ap_uint<4> cw_drain_row = 0;
+    static row_count_t cw_drain_col = 0;
+    
+    // FC streaming: input beats holding the element broadcast to the PEs,
+    // one per image of the batch chunk (the images' beats arrive
+    // interleaved), the element's position within the (beat-aligned) input
+    // row, and the elements of the chunk's input vector taken so far
+    bool fc_stream = (config.layer_type == FC);
+    static axis_beat_t fc_in_beat[FC_BATCH_MAX];
+    #pragma HLS ARRAY_PARTITION variable=fc_in_beat complete
+    static ap_uint<3> fc_in_fill = 0;
+    static idx_t fc_in_lane = 0;
+    static ap_uint<10> fc_in_col = 0;
+    static bool fc_in_valid = false;
+    static ap_uint<20> fc_in_elems = 0;
+    ap_uint<20> fc_inputs = config.input_h * config.input_w * config.input_c;
+    
+    // FC batching: a chunk of up to FC_BATCH_MAX images shares every weight
+    // beat, which is held and applied to one image per cycle. The bias row
+    // is kept as well: after image 0 completes, the other images complete
+    // one by one from it, each reported as its own pass
+    static ap_uint<8> fc_chunk_first = 0;
+    static ap_uint<3> fc_image = 0;
+    static axis_beat_t fc_weight_beat;
+    static axis_beat_t fc_bias_beats[FC_BEATS_PER_INPUT];
+    #pragma HLS ARRAY_PARTITION variable=fc_bias_beats complete
+    static bool fc_replay = false;
+    static bool fc_replay_gap = false;
+    static ap_uint<5> fc_replay_col = 0;
+    ap_uint<8> batch = (batch_size == 0) ? (ap_uint<8>)1 : batch_size;
+    ap_uint<8> images_left = batch - fc_chunk_first;
+    ap_uint<3> fc_images = (images_left < FC_BATCH_MAX) ? (ap_uint<3>)images_left :
+                                                          (ap_uint<3>)FC_BATCH_MAX;
+    
+    // Pooling window and AVG scaling, set up once per layer
+    static PEConfig pool_cfg;
+    
+    // Beat-streaming layers (global pooling, element-wise add): position
+    // within the current channel map
+    static ap_uint<10> stream_row = 0;
+    static ap_uint<10> stream_col = 0;
+    bool gpool = (config.layer_type == GAVGPOOL);
+    bool eltwise = (config.layer_type == ELTWISE_ADD);
+    
+    // Weight-stationary: PE (i, j) holds kernel row i % kh of filter j and
+    // the kh partial sums of a row group are reduced down the column
+    bool weight_stationary = IS_WEIGHT_STATIONARY(config);
+    ap_uint<5> ws_span = weight_stationary ?
+                         (ap_uint<5>)((M_SIZE / config.kernel_h) * config.kernel_h) :
+                         (ap_uint<5>)M_SIZE;
+    
     if (start) {
         cycles = 0;
+        skipped = 0;
+        write_line_idx = 0;
+        write_col = 0;
+        pw_pixels_in = 0;
+        pw_pixels_out = 0;
+        cw_rows_in = 0;
+        cw_band_row = 0;
+        cw_out_row = 0;
+        cw_col = 0;
+        cw_busy[0] = false;
+        cw_busy[1] = false;
+        cw_fill = 0;
+        cw_drain = 0;
+        cw_drain_row = 0;
+        cw_drain_col = 0;
+        fc_in_fill = 0;
+        fc_in_lane = 0;
+        fc_in_col = 0;
+        fc_in_valid = false;
+        fc_in_elems = 0;
+        fc_chunk_first = 0;
+        fc_image = 0;
+        fc_replay = false;
+        fc_replay_gap = false;
+        fc_replay_col = 0;
+        stream_row = 0;
+        stream_col = 0;
+        
+        // Windowed pooling covers kh × kw taps, global pooling a whole map
+        pool_cfg = PEConfig();
+        avg_window(gpool ? (window_t)(config.input_h * config.input_w) :
+                           (window_t)(config.kernel_h * config.kernel_w), pool_cfg);
+        
+        // Pointwise banks are rings of pixel vectors: every address is valid
+        for (int i = 0; i < M_SIZE; i++) {
+            #pragma HLS UNROLL
+            line_banks[i].reset();
+            line_banks[i].set_padding(config.padding,
+                                      pointwise ? (ap_uint<10>)LINE_MEM_WIDTH : config.input_w);
+            line_banks[i].set_stride(config.stride);
+            line_banks[i].set_lane_mode(pointwise ? LANE_BROADCAST :
+                                        channel_wise ? LANE_CHANNELS :
+                                        LANE_WINDOWS);
+        }
+        
+        act_buffer.begin_layer(act_route);
+        skip_buffer.begin_layer(act_route);
+    }
+    
+    // =========================================================================
+    // STEP 0: Weight and Bias Load Phase
+    // =========================================================================
+    
+    // While the KPC is loading a filter group, one packed weight beat per
+    // cycle (AXIS_LANES consecutive weights) is written into the idle bank of
+    // the addressed column; this overlaps with computation on the active
+    // bank, which reads only local BRAM.
+    // Compressed weights arrive as a value beat followed by its metadata
+    // beat; the pair is written (and acknowledged) on the metadata beat
+    static axis_beat_t sparse_values;
+    static bool meta_phase = false;
+    bool sparse = (config.weight_entries != 0);
+    
+    if (start) {
+        meta_phase = false;
+    }
+    
+    bool weight_ack = false;
+    bool fc_image_start = false;
+    
+    if (fc_stream) {
+        // FC streaming: each weight is used once per image, so beats go
+        // straight into the MACs of PEs weight_load_col*AXIS_LANES onwards
+        // (PE i*N_SIZE + j is one output neuron) without touching the weight
+        // memories; throughput is one weight beat per cycle and image
+        for (int i = 0; i < M_SIZE; i++) {
+            #pragma HLS UNROLL
+            for (int j = 0; j < N_SIZE; j++) {
+                #pragma HLS UNROLL
+                pe_valid[i][j] = false;
+                pe_skipped[i][j] = false;
+            }
+        }
+        
+        bool input_ready = fc_bias_row || fc_in_valid;
+        bool beat_held = (fc_image != 0);
+        bool chunk_done = false;
+        
+        // Weight beat (or kept bias beat) of this cycle, its first PE, the
+        // input element it meets and the image whose accumulators it updates
+        ap_uint<3> mac_image = fc_image;
+        axis_beat_t weight_beat;
+        int first_pe = 0;
+        idx_t lanes = 0;
+        data_t fc_input = TO_FIXED(1);
+        bool fc_first = false;
+        bool fc_last = false;
+        bool fc_mac = false;
+        
+        if (fc_replay) {
+            // Later images of the chunk: a pass boundary, then their bias row
+            // from the kept beats (the KPC's next pass waits meanwhile)
+            if (fc_replay_gap) {
+                fc_replay_gap = false;
+                fc_image_start = true;
+            } else {
+                weight_beat = fc_bias_beats[fc_replay_col];
+                first_pe = fc_replay_col * AXIS_LANES;
+                lanes = (TOTAL_PES - first_pe < AXIS_LANES) ?
+                        (idx_t)(TOTAL_PES - first_pe) : (idx_t)AXIS_LANES;
+                fc_last = true;
+                fc_mac = true;
+                
+                fc_replay_col++;
+                if (fc_replay_col == FC_BEATS_PER_INPUT) {
+                    fc_replay_col = 0;
+                    fc_image++;
+                    if (fc_image == fc_images) {
+                        fc_image = 0;
+                        fc_replay = false;
+                        chunk_done = true;
+                    } else {
+                        fc_replay_gap = true;
+                    }
+                }
+            }
+        } else if (weight_load && input_ready && (beat_held || !weight_stream.empty())) {
+            weight_beat = beat_held ? fc_weight_beat : weight_stream.read();
+            fc_weight_beat = weight_beat;
+            
+            // Bias row: weights are the biases, applied to a constant 1
+            fc_input = fc_bias_row ? TO_FIXED(1) : fc_in_beat[fc_image].lane[fc_in_lane];
+            first_pe = weight_load_col * AXIS_LANES;
+            lanes = weight_load_lanes;
+            fc_first = acc_reset;
+            fc_last = fc_bias_row;
+            fc_mac = true;
+            
+            if (fc_bias_row) {
+                // Image 0 completes here; the beat is kept for the others
+                fc_bias_beats[weight_load_col] = weight_beat;
+                weight_ack = true;
+                
+                if (weight_load_col == FC_BEATS_PER_INPUT - 1) {
+                    // The next neuron group replays the input from the start
+                    if (act_route.src_on_chip) {
+                        act_buffer.rewind();
+                    }
+                    if (fc_images > 1) {
+                        fc_replay = true;
+                        fc_replay_gap = true;
+                        fc_image = 1;
+                    } else {
+                        chunk_done = true;
+                    }
+                }
+            } else {
+                // The beat is released once every image of the chunk has used
+                // it; the element has reached every PE after the last beat of
+                // its row (the rest of a row's last beat is padding)
+                fc_image++;
+                if (fc_image == fc_images) {
+                    fc_image = 0;
+                    weight_ack = true;
+                    
+                    if (weight_load_col == FC_BEATS_PER_INPUT - 1) {
+                        fc_in_lane++;
+                        fc_in_col++;
+                        fc_in_elems++;
+                        if (fc_in_col == config.input_w) {
+                            fc_in_col = 0;
+                            fc_in_valid = false;
+                        } else if (fc_in_lane == AXIS_LANES) {
+                            fc_in_valid = false;
+                        }
+                    }
+                }
+            }
+        }
+        
+        if (fc_mac) {
+            // The broadcast element is the shared operand: in INT8, PEs
+            // (i, j) and (i, j+1), which take neighbouring lanes of one
+            // beat, share one DSP48E2 for both products
+            for (int i = 0; i < M_SIZE; i++) {
+                #pragma HLS UNROLL
+                for (int j = 0; j < N_SIZE; j += MACS_PER_DSP) {
+                    #pragma HLS UNROLL
+                    data_t fc_weights[MACS_PER_DSP];
+                    product_t fc_products[MACS_PER_DSP];
+                    for (int k = 0; k < MACS_PER_DSP; k++) {
+                        #pragma HLS UNROLL
+                        int p = i * N_SIZE + j + k;
+                        fc_weights[k] = (p >= first_pe && p < first_pe + lanes) ?
+                                        weight_beat.lane[p - first_pe] : TO_FIXED(0);
+                    }
+                    
+#ifdef CNN_INT8
+                    dual_mac_product(fc_input, fc_weights[0], fc_weights[1],
+                                     fc_products[0], fc_products[1]);
+#else
+                    fc_products[0] = mac_product(fc_input, fc_weights[0]);
+#endif
+                    
+                    for (int k = 0; k < MACS_PER_DSP; k++) {
+                        #pragma HLS UNROLL
+                        int p = i * N_SIZE + j + k;
+                        if (p >= first_pe && p < first_pe + lanes) {
+                            pe_grid[i][j + k].stream_mac(fc_products[k], mac_image,
+                                                         fc_first, fc_last,
+                                                         config.activation == ACT_NONE,
+                                                         config.out_shift, config.out_scale,
+                                                         pe_outputs[i][j + k],
+                                                         pe_valid[i][j + k]);
+                        }
+                    }
+                }
+            }
+        }
+        
+        // The next chunk (or neuron group) starts from its first image and
+        // takes its input once this one has completed
+        if (chunk_done) {
+            fc_chunk_first += fc_images;
+            if (fc_chunk_first == batch) {
+                fc_chunk_first = 0;
+            }
+            images_left = batch - fc_chunk_first;
+            fc_images = (images_left < FC_BATCH_MAX) ? (ap_uint<3>)images_left :
+                                                       (ap_uint<3>)FC_BATCH_MAX;
+            fc_in_elems = 0;
+        }
+    } else if (weight_load && !weight_stream.empty()) {
+        axis_beat_t weight_beat = weight_stream.read();
+        
+        if (sparse && !meta_phase) {
+            sparse_values = weight_beat;
+            meta_phase = true;
+        } else {
+            // Weight-stationary beats go only to the PE rows holding kernel
+            // row weight_load_row
+            for (int i = 0; i < M_SIZE; i++) {
+                #pragma HLS UNROLL
+                
+                bool row_match = !weight_stationary ||
+                                 (i % config.kernel_h == weight_load_row && i < ws_span);
+                
+                for (int j = 0; j < N_SIZE; j++) {
+                    #pragma HLS UNROLL
+                    if (j == weight_load_col && row_match) {
+                        if (sparse) {
+                            pe_grid[i][j].load_sparse_beat(sparse_values, weight_beat,
+                                                           weight_load_lanes,
+                                                           weight_load_addr, weight_load_bank);
+                        } else {
+                            pe_grid[i][j].load_weight_beat(weight_beat, weight_load_lanes,
+                                                           weight_load_addr, weight_load_bank);
+                        }
+                    }
+                }
+            }
+            
+            meta_phase = false;
+            weight_ack = true;
+        }
+    }
+    
+    // Bias burst at the start of each iteration: one bias per filter column
+    bool bias_ack = false;
+    
+    if (bias_load && !bias_stream.empty()) {
+        data_t bias = bias_stream.read();
+        
+        for (int j = 0; j < N_SIZE; j++) {
+            #pragma HLS UNROLL
+            if (j == bias_load_idx) {
+                bias_regs[j] = bias;
+            }
+        }
+        
+        bias_ack = true;
     }
     
     // =========================================================================
     // STEP 1: Input Distribution to Line Memories
     // =========================================================================
     
-    // Read input data and distribute to line memories
-    if (!input_stream.empty()) {
-        data_t input_data = input_stream.read();
+    // Pointwise iterations (and every image of a batch) re-stream every
+    // pixel, and each pass of a grouped convolution streams its group's
+    // channel slice from row 0: realign the banks before the pass pre-fetches.
+    // A depthwise pass is over once its last band is done and its last row
+    // (which the bands may not read) is written
+    bool realign;
+    if (pointwise) {
+        realign = bias_load || kpc_pass_start;
+    } else if (channel_wise) {
+        realign = (cw_out_row == conv_h) && (cw_rows_in == config.input_h);
+    } else {
+        realign = (config.groups > 1 && kpc_pass_start);
+    }
+    if (realign) {
+        write_line_idx = 0;
+        write_col = 0;
+        pw_pixels_in = 0;
+        pw_pixels_out = 0;
+        cw_rows_in = 0;
+        cw_band_row = 0;
+        cw_out_row = 0;
+        
+        for (int i = 0; i < M_SIZE; i++) {
+            #pragma HLS UNROLL
+            line_banks[i].reset();
+        }
+    }
+    
+    // Read one packed beat per cycle and distribute it to line memories.
+    // Beats never straddle rows: each row occupies whole beats and the last
+    // beat of a row is only partially valid. The beat comes from the on-chip
+    // activation buffer when the previous layer left its output there.
+    // FC streaming only takes new beats once the held ones are used up (and
+    // the next chunk's input once this chunk has completed), and
+    // line-memory layers only while the KPC lets the banks be written (a
+    // pointwise pass stops at its last pixel, or two blocks ahead of the
+    // PEs; a depthwise pass at its last row, or at the bank the band's first
+    // row occupies until the band is done). Bottom rows no band reads are
+    // still taken once the pass's bands are done, even after the KPC
+    bool pw_space = (pw_pixels_in < total_pixels) &&
+                    (pw_pixels_in < pw_pixels_out + 2 * M_SIZE);
+    bool cw_tail = channel_wise && (cw_out_row == conv_h);
+    ap_uint<11> cw_first_row = (cw_band_row > config.padding) ?
+                               (ap_uint<11>)(cw_band_row - config.padding) : (ap_uint<11>)0;
+    bool cw_space = (cw_rows_in < config.input_h) &&
+                    (cw_tail || (cw_rows_in < cw_first_row + M_SIZE));
+    bool input_wanted;
+    if (fc_stream) {
+        input_wanted = !fc_in_valid && (fc_in_elems < fc_inputs);
+    } else if (gpool || eltwise) {
+        input_wanted = compute_enable;
+    } else {
+        input_wanted = (write_enable[write_line_idx] || cw_tail) &&
+                       (!pointwise || pw_space) && (!channel_wise || cw_space);
+    }
+    
+    axis_beat_t input_beat;
+    bool input_valid = false;
+    bool input_ack = false;
+    
+    if (input_wanted && act_route.src_on_chip) {
+        input_valid = act_buffer.read_beat(input_beat);
+    } else if (input_wanted && !input_stream.empty()) {
+        input_beat = input_stream.read();
+        input_valid = true;
+    }
+    
+    if (gpool || eltwise) {
+        for (int i = 0; i < M_SIZE; i++) {
+            #pragma HLS UNROLL
+            for (int j = 0; j < N_SIZE; j++) {
+                #pragma HLS UNROLL
+                pe_valid[i][j] = false;
+                pe_skipped[i][j] = false;
+            }
+        }
+    }
+    
+    if (input_valid && fc_stream) {
+        for (int b = 0; b < FC_BATCH_MAX; b++) {
+            #pragma HLS UNROLL
+            if (b == fc_in_fill) {
+                fc_in_beat[b] = input_beat;
+            }
+        }
+        fc_in_fill++;
+        if (fc_in_fill == fc_images) {
+            fc_in_fill = 0;
+            fc_in_lane = 0;
+            fc_in_valid = true;
+        }
+    } else if (input_valid && gpool) {
+        // Global average pooling: the channel maps arrive one after another
+        // in the usual row layout; each beat's lanes are summed and folded
+        // into PE (0, 0), which emits the channel mean after its last beat
+        ap_uint<10> row_remaining = config.input_w - stream_col;
+        idx_t lanes = (row_remaining < AXIS_LANES) ? (idx_t)row_remaining : (idx_t)AXIS_LANES;
         
-        // Distribute input to appropriate line memory based on write_enable
-        // In actual implementation, routing logic would direct to specific line memory
-        // For simplicity, we use round-robin or sequential distribution
-        static ap_uint<5> write_line_idx = 0;
+        pool_sum_t beat_sum = 0;
+        for (int l = 0; l < AXIS_LANES; l++) {
+            #pragma HLS UNROLL
+            if (l < lanes) {
+                beat_sum += input_beat.lane[l];
+            }
+        }
+        
+        bool first = (stream_row == 0 && stream_col == 0);
+        bool last = (stream_row == config.input_h - 1 && lanes == row_remaining);
+        
+        pe_grid[0][0].stream_pool(beat_sum, first, last, pool_cfg,
+                                  pe_outputs[0][0], pe_valid[0][0]);
+        
+        stream_col += lanes;
+        if (stream_col == config.input_w) {
+            stream_col = 0;
+            stream_row++;
+            if (stream_row == config.input_h) {
+                stream_row = 0;
+            }
+        }
         
+        input_ack = true;
+    } else if (input_valid && eltwise) {
+        // Element-wise add: the input beat joins the saved map lane by lane
+        // and leaves as an output beat of the same shape (rows stay beat
+        // aligned on both sides)
+        ap_uint<10> row_remaining = config.input_w - stream_col;
+        idx_t lanes = (row_remaining < AXIS_LANES) ? (idx_t)row_remaining : (idx_t)AXIS_LANES;
+        
+        axis_beat_t skip_beat;
+        if (!skip_buffer.read_beat(skip_beat)) {
+            for (int l = 0; l < AXIS_LANES; l++) {
+                #pragma HLS UNROLL
+                skip_beat.lane[l] = 0;
+            }
+        }
+        
+        axis_beat_t sum_beat;
+        for (int l = 0; l < AXIS_LANES; l++) {
+            #pragma HLS UNROLL
+            data_t sum = residual_add(input_beat.lane[l], skip_beat.lane[l]);
+            sum_beat.lane[l] = output_activation(sum, config, true);
+        }
+        emit_output_beat(sum_beat, lanes, act_route, act_buffer, skip_buffer, output_stream);
+        
+        stream_col += lanes;
+        if (stream_col == config.input_w) {
+            stream_col = 0;
+        }
+        
+        input_ack = true;
+    } else if (input_valid) {
+        
+        // Depthwise and pooling rows interleave the N_SIZE channels of the
+        // current channel group pixel by pixel; pointwise "rows" are the
+        // channel vector of one pixel (the group's kernel_d channels, at
+        // most PW_MAX_DEPTH: deeper layers are rejected by the IEC, see
+        // LAYER_UNSUPPORTED)
+        row_count_t row_values;
+        if (pointwise) {
+            row_values = config.kernel_d;
+        } else if (channel_wise) {
+            row_values = config.input_w * N_SIZE;
+        } else {
+            row_values = config.input_w;
+        }
+        row_count_t row_remaining = row_values - write_col;
+        idx_t lanes = (row_remaining < AXIS_LANES) ? (idx_t)row_remaining : (idx_t)AXIS_LANES;
+        
+        // Feature map rows are distributed row-by-row: row r of the input
+        // is stored in bank r % M_SIZE so that all m banks can be read
+        // in parallel by the PE rows. Depthwise rows are read by column, so
+        // each one starts at address 0 of its bank
         for (int i = 0; i < M_SIZE; i++) {
             #pragma HLS UNROLL
             
             if (write_enable[i] && i == write_line_idx) {
-                // Write to this line memory
-                line_memory(
-                    input_data,
-                    true,  // write_enable
-                    false, // read_enable
-                    0, 0, 0,
-                    ra_r[i], ra_n[i],
-                    next_stride,
-                    config.rl,
-                    line_outputs[i],
-                    line_ready[i]
-                );
+                if (channel_wise && write_col == 0) {
+                    line_banks[i].begin_row();
+                }
+                line_banks[i].write_beat(input_beat, lanes);
             }
         }
         
-        write_line_idx++;
-        if (write_line_idx >= M_SIZE) {
-            write_line_idx = 0;
+        write_col += lanes;
+        if (write_col >= row_values) {
+            write_col = 0;
+            pw_pixels_in++;
+            cw_rows_in++;
+            write_line_idx++;
+            if (write_line_idx >= M_SIZE) {
+                write_line_idx = 0;
+            }
         }
     }
     
@@ -116,71 +753,186 @@ void pe_array(
     for (int i = 0; i < M_SIZE; i++) {
         #pragma HLS UNROLL
         
-        if (read_enable[i]) {
-            // Read n outputs from this line memory
-            line_memory(
-                0,            // data_in (not used for read)
-                false,        // write_enable
-                true,         // read_enable
-                0, 0,
-                reuse_mode[i] ? 1 : 0,
-                ra_r[i], ra_n[i],
-                next_stride,
-                config.rl,
-                line_outputs[i],
-                line_ready[i]
-            );
+        // Load new/reuse addresses from the KPC on stride transitions
+        if (next_stride) {
+            line_banks[i].set_read_pointers(ra_n[i], ra_r[i]);
         }
+        
+        // Read n outputs from this bank (holds previous outputs when idle)
+        line_banks[i].read_data(
+            read_enable[i],
+            reuse_mode[i],
+            config.rl,
+            line_outputs[i],
+            line_ready[i]
+        );
     }
     
     // =========================================================================
     // STEP 3: PE Array Computation
     // =========================================================================
     
-    // Process with PE array
-    for (int i = 0; i < M_SIZE; i++) {
-        #pragma HLS UNROLL
+    // Process with PE array (FC streaming already ran its MACs in STEP 0,
+    // global pooling and element-wise adds their work in STEP 1)
+    if (!fc_stream && !gpool && !eltwise) {
+        // Gather the inputs of each column from all m line memories
+        data_t pe_inputs[N_SIZE][M_SIZE];
+        #pragma HLS ARRAY_PARTITION variable=pe_inputs complete dim=0
         
         for (int j = 0; j < N_SIZE; j++) {
             #pragma HLS UNROLL
-            
-            // Gather inputs for this PE from all m line memories
-            data_t pe_inputs[M_SIZE];
-            #pragma HLS ARRAY_PARTITION variable=pe_inputs complete
-            
             for (int k = 0; k < M_SIZE; k++) {
                 #pragma HLS UNROLL
-                pe_inputs[k] = line_outputs[k][j];
+                pe_inputs[j][k] = line_outputs[k][j];
             }
+        }
+        
+        PEConfig pe_cfg[M_SIZE][N_SIZE];
+        #pragma HLS ARRAY_PARTITION variable=pe_cfg complete dim=0
+        
+        // Weight-stationary row groups add the bias once, in their first
+        // kernel row
+        data_t pe_bias[M_SIZE][N_SIZE];
+        #pragma HLS ARRAY_PARTITION variable=pe_bias complete dim=0
+        
+        for (int i = 0; i < M_SIZE; i++) {
+            #pragma HLS UNROLL
             
-            // Read weight from stream (if available)
-            data_t weight = 0;
-            if (!weight_stream.empty()) {
-                weight = weight_stream.read();
+            for (int j = 0; j < N_SIZE; j++) {
+                #pragma HLS UNROLL
+                
+                pe_cfg[i][j].line_select = line_selection[i][j];
+                if (config.layer_type == CONV || config.layer_type == FC ||
+                    config.layer_type == DWCONV) {
+                    pe_cfg[i][j].op = PE_OP_MAC;
+                } else if (config.layer_type == AVGPOOL) {
+                    pe_cfg[i][j].op = PE_OP_AVG;
+                } else {
+                    pe_cfg[i][j].op = PE_OP_MAX;
+                }
+                pe_cfg[i][j].window_size = pool_cfg.window_size;
+                pe_cfg[i][j].avg_pow2 = pool_cfg.avg_pow2;
+                pe_cfg[i][j].avg_shift = pool_cfg.avg_shift;
+                pe_cfg[i][j].avg_recip = pool_cfg.avg_recip;
+                pe_cfg[i][j].out_shift = config.out_shift;
+                pe_cfg[i][j].out_scale = config.out_scale;
+                // The activation follows a residual add or the
+                // weight-stationary column reduction, so the PE keeps the
+                // sign then
+                pe_cfg[i][j].sign_override = (config.activation == ACT_NONE) ||
+                                             act_route.skip_add || weight_stationary;
+                pe_cfg[i][j].enable = compute_enable && row_enable[i];
+                pe_cfg[i][j].pad_input = pad_row[i];
+                // Restart from the bias at the first window of an iteration and
+                // after every completed output (pe_valid holds last cycle's flag);
+                // pointwise and depthwise PEs restart by themselves in the
+                // completing cycle
+                pe_cfg[i][j].continuous = pointwise || channel_wise;
+                pe_cfg[i][j].reset = acc_reset || (pe_valid[i][j] && !pe_cfg[i][j].continuous);
+                pe_cfg[i][j].weight_bank = weight_bank;
+                pe_cfg[i][j].zero_skip = config.zero_skip;
+                pe_cfg[i][j].sparse = sparse;
+                
+                bool bias_pos = !weight_stationary || (i % config.kernel_h == 0);
+                pe_bias[i][j] = bias_pos ? bias_regs[j] : TO_FIXED(0);
             }
+        }
+        
+#ifdef CNN_INT8
+        // INT8: rows 2p and 2p+1 of a column hold the same filter, so each
+        // pair shares one DSP48E2 for both of its multiplies
+        for (int i = 0; i < M_SIZE; i += 2) {
+            #pragma HLS UNROLL
             
-            // Read bias from stream (if available)
-            data_t bias = 0;
-            if (!bias_stream.empty()) {
-                bias = bias_stream.read();
+            for (int j = 0; j < N_SIZE; j++) {
+                #pragma HLS UNROLL
+                
+                // Execute PEs (i, j) and (i+1, j)
+                PE::compute_pair(
+                    pe_grid[i][j],
+                    pe_grid[i + 1][j],
+                    pe_inputs[j],
+                    pe_inputs[j],
+                    pe_cfg[i][j],
+                    pe_cfg[i + 1][j],
+                    pe_bias[i][j],
+                    pe_bias[i + 1][j],
+                    pe_outputs[i][j],
+                    pe_outputs[i + 1][j],
+                    pe_stride_req[i][j],
+                    pe_stride_req[i + 1][j],
+                    pe_valid[i][j],
+                    pe_valid[i + 1][j],
+                    pe_skipped[i][j],
+                    pe_skipped[i + 1][j]
+                );
             }
+        }
+#else
+        for (int i = 0; i < M_SIZE; i++) {
+            #pragma HLS UNROLL
             
-            // Execute PE
-            pe_unit(
-                pe_inputs,
-                weight,
-                bias,
-                line_selection[i][j],
-                (config.layer_type == CONV || config.layer_type == FC), // mac_max_mode
-                false,  // sign_override (handle separately for first layer)
-                compute_enable,
-                (start && cycles == 0),  // reset on start
-                pe_outputs[i][j],
-                pe_stride_req[i][j],
-                pe_valid[i][j]
-            );
+            for (int j = 0; j < N_SIZE; j++) {
+                #pragma HLS UNROLL
+                
+                // Execute PE (i, j)
+                pe_grid[i][j].compute(
+                    pe_inputs[j],
+                    pe_cfg[i][j],
+                    pe_bias[i][j],
+                    pe_outputs[i][j],
+                    pe_stride_req[i][j],
+                    pe_valid[i][j],
+                    pe_skipped[i][j]
+                );
+            }
         }
+#endif
+    }
+    
+    // A pointwise block retires when its PEs complete (row 0 always holds a
+    // pixel); the next block may start once all of its pixels are written
+    if (pointwise && pe_valid[0][0]) {
+        pw_pixels_out += M_SIZE;
     }
+    ap_uint<20> block_end = pw_pixels_out + M_SIZE;
+    bool pw_ready = (pw_pixels_in >= ((block_end < total_pixels) ? block_end : total_pixels));
+    
+    // A depthwise window completes in every column at once (PE row 0 always
+    // holds a band row): its outputs go to the band's buffer, and after
+    // conv_w windows the band is handed to the drain
+    if (channel_wise && pe_valid[0][0]) {
+        for (int i = 0; i < M_SIZE; i++) {
+            #pragma HLS UNROLL
+            for (int j = 0; j < N_SIZE; j++) {
+                #pragma HLS UNROLL
+                cw_rows[cw_fill][i][cw_col * N_SIZE + j] = pe_outputs[i][j];
+            }
+        }
+        
+        cw_col++;
+        if (cw_col == conv_w) {
+            ap_uint<10> rows_left = conv_h - cw_out_row;
+            ap_uint<4> band_rows = (rows_left < cw_band_rows) ? (ap_uint<4>)rows_left :
+                                                                cw_band_rows;
+            cw_rows_held[cw_fill] = band_rows;
+            cw_busy[cw_fill] = true;
+            cw_fill = ~cw_fill;
+            cw_col = 0;
+            cw_band_row += cw_band_rows * config.stride;
+            cw_out_row += band_rows;
+        }
+    }
+    
+    // The next band may start once the rows it reads are written and its
+    // buffer is free; the first band of a pass also waits for the previous
+    // pass to drain, so the passes leave in order
+    ap_int<13> cw_band_end = (ap_int<13>)cw_band_row - config.padding +
+                             (cw_band_rows - 1) * config.stride + config.kernel_h;
+    ap_int<13> cw_rows_needed = (cw_band_end < config.input_h) ? cw_band_end :
+                                (ap_int<13>)config.input_h;
+    bool cw_ready = ((ap_int<13>)cw_rows_in >= cw_rows_needed) && !cw_busy[cw_fill] &&
+                    (cw_out_row != 0 || (!cw_busy[0] && !cw_busy[1]));
     
     // =========================================================================
     // STEP 4: Kernel Processing Controller
@@ -188,7 +940,12 @@ void pe_array(
     
     kpc_controller(
         config,
+        batch_size,
         start,
+        weight_ack,
+        bias_ack,
+        input_ack,
+        pointwise ? pw_ready : cw_ready,
         pe_stride_req,
         line_selection,
         read_enable,
@@ -196,8 +953,22 @@ void pe_array(
         reuse_mode,
         ra_r,
         ra_n,
+        pad_row,
+        row_enable,
+        weight_load,
+        weight_load_col,
+        weight_load_row,
+        weight_load_addr,
+        weight_load_lanes,
+        weight_load_bank,
+        weight_bank,
+        bias_load,
+        bias_load_idx,
         next_stride,
         compute_enable,
+        acc_reset,
+        fc_bias_row,
+        kpc_pass_start,
         kpc_done
     );
     
@@ -205,48 +976,192 @@ void pe_array(
     // STEP 5: Output Collection
     // =========================================================================
     
-    // Collect valid outputs from PEs and write to output stream
+    // Output packer: valid outputs are gathered into AXIS_LANES-wide beats.
+    // Output rows start on beat boundaries (same layout as the input stream),
+    // so a layer's output can feed the next layer directly
+    static axis_beat_t out_beat;
+    static idx_t out_lanes = 0;
+    static ap_uint<10> out_col = 0;
+    
+    // Skip-map beat matching the output beat being packed
+    static axis_beat_t skip_beat;
+    
+    // Fused max-pool stage between activation and the packer
+    static PoolUnit pool;
+    static bool pool_enable = false;
+    
+    // Every pass (filter group, batch image) writes its own output map:
+    // flush what is left of the previous one and restart the pool windows
+    if (kpc_pass_start && out_lanes != 0) {
+        emit_output_beat(out_beat, out_lanes, act_route,
+                         act_buffer, skip_buffer, output_stream);
+    }
+    
+    if (start || kpc_pass_start) {
+        out_lanes = 0;
+        out_col = 0;
+        
+        // Pooling consumes the un-pooled conv output rows
+        pool_enable = (config.pool_size > 1);
+        ap_uint<10> conv_w = (config.input_w + 2 * config.padding - config.kernel_w) /
+                             config.stride + 1;
+        pool.configure(config.pool_size, config.pool_stride, conv_w);
+    }
+    
+    // Collect valid outputs from PEs and write to output stream.
+    // Weight-stationary row groups finish together; the last row of each
+    // group emits the column sum of their raw accumulators, requantised
+    // once. Pointwise outputs are pixel-major: the N_SIZE filter outputs of
+    // a pixel form one beat-aligned row. Depthwise outputs leave through the
+    // band buffers instead
+    ap_uint<10> out_row_len = pointwise ? (ap_uint<10>)N_SIZE : config.output_w;
+    
     for (int i = 0; i < M_SIZE; i++) {
         #pragma HLS PIPELINE II=1
         
+        bool group_end = !channel_wise &&
+                         (!weight_stationary || (i % config.kernel_h == config.kernel_h - 1));
+        
         for (int j = 0; j < N_SIZE; j++) {
             #pragma HLS UNROLL
             
-            if (pe_valid[i][j]) {
-                // Apply activation based on layer type
-                data_t activated_output;
+            if (pe_valid[i][j] && group_end) {
+                // Residual join: the saved map is packed exactly like this
+                // output, so lane out_lanes of its next beat is the matching
+                // element; it is added before the activation
+                data_t pre_activation = pe_outputs[i][j];
                 
-                switch (config.layer_type) {
-                    case RELU:
-                        activated_output = relu_with_szd(pe_outputs[i][j]);
-                        break;
-                    
-                    case RELU6:
-                        activated_output = relu6_with_szd(pe_outputs[i][j]);
-                        break;
-                    
-                    case MAXPOOL:
-                    case AVGPOOL:
-                    case CONV:
-                    case FC:
-                    default:
-                        activated_output = pe_outputs[i][j];
-                        break;
+                if (weight_stationary) {
+                    acc_t column_sum = 0;
+                    for (int r = 0; r < M_SIZE; r++) {
+                        #pragma HLS UNROLL
+                        if (r / config.kernel_h == i / config.kernel_h) {
+                            column_sum += pe_grid[r][j].partial_sum();
+                        }
+                    }
+                    pre_activation = requantize(column_sum, config.out_shift, config.out_scale);
+                }
+                
+                if (act_route.skip_add) {
+                    if (out_lanes == 0 && !skip_buffer.read_beat(skip_beat)) {
+                        for (int l = 0; l < AXIS_LANES; l++) {
+                            #pragma HLS UNROLL
+                            skip_beat.lane[l] = 0;
+                        }
+                    }
+                    pre_activation = residual_add(pre_activation, skip_beat.lane[out_lanes]);
+                }
+                
+                // Apply activation: standalone RELU/RELU6 layers or the
+                // activation fused into a CONV/FC layer (the PE already
+                // applied ReLU unless sign override was set)
+                data_t activated_output = output_activation(pre_activation, config,
+                                                            act_route.skip_add ||
+                                                            weight_stationary);
+                
+                // Fused max-pool: only completed windows reach the packer
+                if (pool_enable && !pool.process(activated_output, activated_output)) {
+                    continue;
                 }
                 
-                // Write to output stream
-                if (!output_stream.full()) {
-                    output_stream.write(activated_output);
+                // Pack into the current beat; emit it once all lanes are
+                // filled or the output row ends
+                out_beat.lane[out_lanes] = activated_output;
+                out_lanes++;
+                out_col++;
+                
+                bool row_end = (out_col == out_row_len);
+                if (out_lanes == AXIS_LANES || row_end) {
+                    emit_output_beat(out_beat, out_lanes, act_route,
+                                     act_buffer, skip_buffer, output_stream);
+                    out_lanes = 0;
+                }
+                if (row_end) {
+                    out_col = 0;
                 }
             }
         }
     }
     
+    // Flush the partially filled last beat of the layer
+    if (kpc_done && out_lanes != 0) {
+        emit_output_beat(out_beat, out_lanes, act_route,
+                         act_buffer, skip_buffer, output_stream);
+        out_lanes = 0;
+    }
+    
+    // Depthwise drain: one beat of the oldest completed band per cycle, row
+    // by row; a row holds conv_w pixels of N_SIZE interleaved channels (the
+    // input layout). The residual join and activation happen here, as in
+    // the packer above
+    if (channel_wise && cw_busy[cw_drain]) {
+        row_count_t row_len = conv_w * N_SIZE;
+        row_count_t row_remaining = row_len - cw_drain_col;
+        idx_t lanes = (row_remaining < AXIS_LANES) ? (idx_t)row_remaining : (idx_t)AXIS_LANES;
+        
+        axis_beat_t band_skip;
+        if (!act_route.skip_add || !skip_buffer.read_beat(band_skip)) {
+            for (int l = 0; l < AXIS_LANES; l++) {
+                #pragma HLS UNROLL
+                band_skip.lane[l] = 0;
+            }
+        }
+        
+        axis_beat_t band_beat;
+        for (int l = 0; l < AXIS_LANES; l++) {
+            #pragma HLS UNROLL
+            data_t value = (l < lanes) ? cw_rows[cw_drain][cw_drain_row][cw_drain_col + l] :
+                                         TO_FIXED(0);
+            band_beat.lane[l] = output_activation(residual_add(value, band_skip.lane[l]), config,
+                                                  act_route.skip_add);
+        }
+        emit_output_beat(band_beat, lanes, act_route, act_buffer, skip_buffer, output_stream);
+        
+        cw_drain_col += lanes;
+        if (cw_drain_col == row_len) {
+            cw_drain_col = 0;
+            cw_drain_row++;
+            if (cw_drain_row == cw_rows_held[cw_drain]) {
+                cw_drain_row = 0;
+                cw_busy[cw_drain] = false;
+                cw_drain = ~cw_drain;
+            }
+        }
+    }
+    
+    // The write-back moves on at a pass boundary and the layer ends only
+    // once the last depthwise band of the pass has drained (and the pass's
+    // unread bottom rows have left the input stream), or the later images
+    // of an FC chunk have completed; each of those images starts a pass
+    static bool pass_pending = false;
+    bool array_busy = cw_busy[0] || cw_busy[1] || fc_replay;
+    if (start) {
+        pass_pending = false;
+    }
+    pass_pending = pass_pending || kpc_pass_start;
+    
     // Update cycle count
-    if (!kpc_done) {
+    if (!kpc_done || array_busy) {
         cycles++;
     }
     
+    // Count the MACs gated by zero skip this cycle (energy, not time)
+    ap_uint<COUNT_BITS(TOTAL_PES)> skipped_now = 0;
+    for (int i = 0; i < M_SIZE; i++) {
+        #pragma HLS UNROLL
+        for (int j = 0; j < N_SIZE; j++) {
+            #pragma HLS UNROLL
+            skipped_now += pe_skipped[i][j] ? 1 : 0;
+        }
+    }
+    skipped += skipped_now;
+    
     cycle_count = cycles;
-    done = kpc_done;
+    skipped_macs = skipped;
+    
+    pass_start = fc_image_start || (pass_pending && !array_busy);
+    done = kpc_done && !array_busy && !pass_pending && !cw_tail;
+    if (!array_busy) {
+        pass_pending = false;
+    }
 }
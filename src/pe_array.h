@@ -11,27 +11,33 @@
 #include "pe_unit.h"
 #include "line_memory.h"
 #include "kpc_controller.h"
+#include "activation_buffer.h"
+#include "pool_unit.h"
 
 /******************************************************************************
  * PE ARRAY FUNCTION
  ******************************************************************************/
 
 void pe_array(
-    // Input/output streams
-    hls::stream<data_t> &input_stream,
-    hls::stream<data_t> &weight_stream,
+    // Input/output streams (input, weights and outputs packed AXIS_LANES wide)
+    hls::stream<axis_beat_t> &input_stream,
+    hls::stream<axis_beat_t> &weight_stream,
     hls::stream<data_t> &bias_stream,
-    hls::stream<data_t> &output_stream,
+    hls::stream<axis_beat_t> &output_stream,
     
     // Configuration
     LayerConfig config,
+    ActivationRoute act_route,      // On-chip activation buffer banks
+    ap_uint<8> batch_size,          // Images per filter group pass
     
     // Control
     bool start,
     bool &done,
+    bool &pass_start,               // Next (filter group, image) pass begins
     
     // Status
-    ap_uint<32> &cycle_count
+    ap_uint<32> &cycle_count,
+    ap_uint<32> &skipped_macs       // PE MACs gated by zero skip (current layer)
 );
 
 #endif // PE_ARRAY_H
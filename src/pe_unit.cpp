@@ -10,91 +10,230 @@
  * PE CLASS IMPLEMENTATION
  ******************************************************************************/
 
-void PE::compute(
+bool PE::issue(
     data_t input_data[M_SIZE],
-    ap_uint<5> line_selection,
-    bool mac_max_mode,
-    bool sign_override,
+    PEConfig cfg,
     data_t bias_psum,
-    bool enable,
-    bool reset_acc,
-    data_t &output,
+    data_t &mac_input,
+    data_t &mac_weight,
     bool &stride_request,
-    bool &valid
+    bool &valid,
+    bool &skipped
 ) {
-    #pragma HLS INLINE off
-    #pragma HLS PIPELINE II=1
-    #pragma HLS ARRAY_PARTITION variable=input_data complete
+    #pragma HLS INLINE
     
     // Initialize outputs
     valid = false;
     stride_request = false;
-    output = 0;
+    skipped = false;
+    mac_input = 0;
+    mac_weight = 0;
     
-    if (!enable) {
-        return;
+    if (!cfg.enable) {
+        return false;
     }
     
     // Reset handling
-    if (reset_acc) {
-        accumulator = bias_psum;  // Initialize with bias
+    if (cfg.reset) {
+        // MAC starts from the bias, MAX from the most negative value and
+        // AVG from an empty window sum
+        if (cfg.op == PE_OP_MAX) {
+            accumulator = DATA_MIN;
+        } else {
+            accumulator = bias_psum;  // Initialize with bias
+        }
+        pool_sum = 0;
         weight_addr = 0;
         input_count = 0;
         computing = true;
-        return;
+        return false;
     }
     
     if (!computing) {
-        return;
+        return false;
     }
     
-    // Line selection MUX: Select input from one of m line memories
-    data_t selected_input = input_data[line_selection];
+    // Line selection MUX: Select input from one of m line memories. Dense
+    // weights follow the KPC's line select; compressed entries carry their
+    // own line offset, so zero weights are never visited
+    weight_meta_t meta = weight_meta[cfg.weight_bank][weight_addr];
+    ap_uint<5> line = cfg.sparse ? (ap_uint<5>)META_LINE(meta) : cfg.line_select;
+    data_t selected_input = cfg.pad_input ? TO_FIXED(0) : input_data[line];
     
-    // Fetch weight from weight memory
-    data_t current_weight = weight_memory[weight_addr];
-    
-    if (mac_max_mode) {
-        // MAC Mode: Multiply-Accumulate
-        accumulator = mac_unit(selected_input, current_weight, accumulator, false);
+    if (cfg.op == PE_OP_MAC) {
+        // MAC Mode: Multiply-Accumulate. A zero input contributes nothing,
+        // so with zero skip the SZD gates both the weight read and the MAC
+        // and only the weight address advances
+        SZDResult input_szd = szd_detector(selected_input);
+        
+        if (cfg.zero_skip && input_szd.is_zero) {
+            skipped = true;
+        } else {
+            // Fetch weight from the active weight memory bank
+            mac_input = selected_input;
+            mac_weight = weight_memory[cfg.weight_bank][weight_addr];
+        }
         
         // Increment weight address
         weight_addr++;
         
-        // Check if we need more input data (stride request)
+        // Check if we need more input data (stride request): after n
+        // inputs, or after the last stored weight of a compressed group
         input_count++;
-        if (input_count % N_SIZE == 0) {  // After processing n inputs
+        if (cfg.sparse ? META_GROUP_END(meta) : (input_count % N_SIZE == 0)) {
             stride_request = true;
         }
         
-    } else {
+    } else if (cfg.op == PE_OP_MAX) {
         // MAX Mode: Max pooling
         accumulator = max_module(accumulator, selected_input);
+        input_count++;
         stride_request = true;  // Always request next in pooling
+        
+    } else {
+        // AVG Mode: the MAC adder sums the window (unit weight) in the wide
+        // pool register; the mean is formed once the window is complete
+        pool_sum = pool_sum + (pool_sum_t)selected_input;
+        input_count++;
+        stride_request = true;
+    }
+    
+    return true;
+}
+
+void PE::retire(
+    product_t product,
+    PEConfig cfg,
+    data_t bias_psum,
+    data_t &output,
+    bool &valid
+) {
+    #pragma HLS INLINE
+    
+    output = 0;
+    
+    if (cfg.op == PE_OP_MAC) {
+        accumulator = accumulator + product;
     }
     
     // Output generation (when computation for this output is complete)
-    // This happens after processing all required inputs for one output
-    bool computation_complete = (weight_addr >= WEIGHT_MEM_DEPTH) || 
-                                (input_count >= N_SIZE && !mac_max_mode);
+    // This happens after processing all required inputs for one output:
+    // every stored weight for MAC, the whole window for MAX/AVG
+    bool computation_complete = (cfg.op == PE_OP_MAC) ?
+                                (weight_addr >= weight_count[cfg.weight_bank]) :
+                                (input_count >= cfg.window_size);
     
     if (computation_complete) {
-        // Apply activation if needed
-        SZDResult szd = szd_detector(accumulator);
+        if (cfg.op == PE_OP_AVG) {
+            accumulator = avg_scale(pool_sum, cfg.avg_pow2, cfg.avg_shift, cfg.avg_recip);
+        }
         
-        if (sign_override) {
+        // Requantise the accumulator to the activation format, then apply
+        // the activation if needed
+        data_t result = requantize(accumulator, cfg.out_shift, cfg.out_scale);
+        SZDResult szd = szd_detector(result);
+        
+        if (cfg.sign_override) {
             // First layer: keep original value
-            output = accumulator;
+            output = result;
         } else {
             // Apply ReLU (zero out negative values)
-            output = szd.is_negative ? TO_FIXED(0) : accumulator;
+            output = szd.is_negative ? TO_FIXED(0) : result;
         }
         
         valid = true;
-        computing = false;  // Ready for next computation
+        
+        if (cfg.continuous) {
+            // Next output starts in the following cycle without a reset,
+            // from the same value a reset would load
+            if (cfg.op == PE_OP_MAX) {
+                accumulator = DATA_MIN;
+            } else {
+                accumulator = bias_psum;
+            }
+            pool_sum = 0;
+            weight_addr = 0;
+            input_count = 0;
+        } else {
+            computing = false;  // Ready for next computation
+        }
+    }
+}
+
+void PE::compute(
+    data_t input_data[M_SIZE],
+    PEConfig cfg,
+    data_t bias_psum,
+    data_t &output,
+    bool &stride_request,
+    bool &valid,
+    bool &skipped
+) {
+    #pragma HLS INLINE off
+    #pragma HLS PIPELINE II=1
+    #pragma HLS ARRAY_PARTITION variable=input_data complete
+    
+    data_t mac_input, mac_weight;
+    
+    output = 0;
+    if (issue(input_data, cfg, bias_psum, mac_input, mac_weight,
+              stride_request, valid, skipped)) {
+        retire(mac_product(mac_input, mac_weight), cfg, bias_psum, output, valid);
     }
 }
 
+#ifdef CNN_INT8
+void PE::compute_pair(
+    PE &upper,
+    PE &lower,
+    data_t upper_inputs[M_SIZE],
+    data_t lower_inputs[M_SIZE],
+    PEConfig upper_cfg,
+    PEConfig lower_cfg,
+    data_t upper_bias,
+    data_t lower_bias,
+    data_t &upper_output,
+    data_t &lower_output,
+    bool &upper_stride_request,
+    bool &lower_stride_request,
+    bool &upper_valid,
+    bool &lower_valid,
+    bool &upper_skipped,
+    bool &lower_skipped
+) {
+    #pragma HLS INLINE off
+    #pragma HLS PIPELINE II=1
+    #pragma HLS ARRAY_PARTITION variable=upper_inputs complete
+    #pragma HLS ARRAY_PARTITION variable=lower_inputs complete
+    
+    data_t upper_input, upper_weight, lower_input, lower_weight;
+    
+    bool upper_active = upper.issue(upper_inputs, upper_cfg, upper_bias, upper_input,
+                                    upper_weight, upper_stride_request, upper_valid,
+                                    upper_skipped);
+    bool lower_active = lower.issue(lower_inputs, lower_cfg, lower_bias, lower_input,
+                                    lower_weight, lower_stride_request, lower_valid,
+                                    lower_skipped);
+    
+    // Both PEs walk the same filter in lockstep, so they read the same
+    // weight; take it from whichever PE actually fetched it (an unread
+    // weight only meets a zero input)
+    data_t shared_weight = (upper_active && !upper_skipped) ? upper_weight : lower_weight;
+    
+    product_t upper_product, lower_product;
+    dual_mac_product(shared_weight, upper_input, lower_input, upper_product, lower_product);
+    
+    upper_output = 0;
+    lower_output = 0;
+    if (upper_active) {
+        upper.retire(upper_product, upper_cfg, upper_bias, upper_output, upper_valid);
+    }
+    if (lower_active) {
+        lower.retire(lower_product, lower_cfg, lower_bias, lower_output, lower_valid);
+    }
+}
+#endif
+
 /******************************************************************************
  * STANDALONE PE FUNCTION
  ******************************************************************************/
@@ -102,44 +241,59 @@ void PE::compute(
 void pe_unit(
     data_t I[M_SIZE],
     data_t W,
+    bool weight_load,
+    addr_t weight_load_addr,
+    ap_uint<1> weight_bank,
     data_t B_Psum,
     ap_uint<5> line_selection,
-    bool mac_max_mode,
+    pe_op_t op,
+    window_t window_size,
     bool sign_override,
     bool enable,
     bool reset,
+    bool zero_skip,
     data_t &AC_Psum,
     bool &stride_request,
-    bool &valid
+    bool &valid,
+    bool &skipped
 ) {
     #pragma HLS INLINE off
     #pragma HLS PIPELINE II=1
     #pragma HLS ARRAY_PARTITION variable=I complete
     
     // Static PE instance (maintains state across calls)
+    // Single-PE top only: pe_array() instantiates its own M_SIZE×N_SIZE grid
     static PE pe_instance;
     #pragma HLS RESET variable=pe_instance
     
-    // Weight loading mode vs compute mode
-    static bool weight_load_mode = false;
-    static addr_t weight_load_addr = 0;
+    // Weight load into the idle bank (overlaps with computation)
+    if (weight_load) {
+        pe_instance.load_weight(W, weight_load_addr, ~weight_bank);
+    }
     
-    // If weight input is valid (non-zero or explicit load signal), load it
-    // In actual implementation, you'd have a separate control signal
-    // For simplicity, we assume weights are pre-loaded
+    PEConfig cfg;
+    cfg.line_select = line_selection;
+    cfg.op = op;
+    if (op == PE_OP_AVG) {
+        avg_window(window_size, cfg);
+    } else {
+        cfg.window_size = window_size;
+    }
+    cfg.sign_override = sign_override;
+    cfg.enable = enable;
+    cfg.reset = reset;
+    cfg.weight_bank = weight_bank;
+    cfg.zero_skip = zero_skip;
     
     // Compute operation
     pe_instance.compute(
         I,
-        line_selection,
-        mac_max_mode,
-        sign_override,
+        cfg,
         B_Psum,
-        enable,
-        reset,
         AC_Psum,
         stride_request,
-        valid
+        valid,
+        skipped
     );
 }
 
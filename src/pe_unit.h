@@ -13,26 +13,97 @@
  * PE SUB-COMPONENTS
  ******************************************************************************/
 
-// MAC Unit: Multiply-Accumulate with 16-bit precision
-data_t mac_unit(data_t input, data_t weight, data_t accumulator, bool reset) {
+// Multiplier: one full-precision product per DSP (16-bit build)
+inline product_t mac_product(data_t input, data_t weight) {
+    #pragma HLS INLINE
+    return (product_t)(input * weight);
+}
+
+// MAC Unit: Multiply-Accumulate into the accumulator format
+inline acc_t mac_unit(data_t input, data_t weight, acc_t accumulator, bool reset) {
     #pragma HLS INLINE
     #pragma HLS PIPELINE II=1
     
     if (reset) {
-        return input * weight;
+        return mac_product(input, weight);
     } else {
-        return accumulator + (input * weight);
+        return accumulator + mac_product(input, weight);
     }
 }
 
+// Requantisation at the PE output: scale and shift the accumulator, then
+// round and saturate it back to data_t
+inline data_t requantize(acc_t value, ap_uint<5> shift, scale_t scale) {
+    #pragma HLS INLINE
+    ap_fixed<ACC_WIDTH + 16, ACC_INT_BITS + 1> scaled = value * scale;
+    return (data_t)(requant_t)(scaled >> shift);
+}
+
+// Residual join: two activations summed one bit wider and saturated back,
+// like requantize, so an overflowing sum clips instead of wrapping negative
+inline data_t residual_add(data_t a, data_t b) {
+    #pragma HLS INLINE
+    ap_fixed<DATA_WIDTH + 1, INT_BITS + 1> sum = a + b;
+    return (data_t)(requant_t)sum;
+}
+
+#ifdef CNN_INT8
+// Dual int8 multiplier on one DSP48E2: both activations ride the 27-bit
+// pre-adder port 18 bits apart and meet the shared weight on the 18-bit
+// port. The low product is the bottom 18 bits of the result; the high one
+// sits above it, less the borrow of a negative low product
+inline void dual_mac_product(data_t weight, data_t input_hi, data_t input_lo,
+                             product_t &product_hi, product_t &product_lo) {
+    #pragma HLS INLINE
+    
+    ap_int<DATA_WIDTH> w = weight.range(DATA_WIDTH - 1, 0);
+    ap_int<DATA_WIDTH> a = input_hi.range(DATA_WIDTH - 1, 0);
+    ap_int<DATA_WIDTH> b = input_lo.range(DATA_WIDTH - 1, 0);
+    
+    ap_int<27> packed = ((ap_int<27>)a << 18) + (ap_int<27>)b;
+    ap_int<45> p = packed * (ap_int<18>)w;
+    
+    ap_int<18> lo = p.range(17, 0);
+    ap_int<2 * DATA_WIDTH> hi = (ap_int<27>)p.range(44, 18) + (ap_int<27>)(p[17] ? 1 : 0);
+    
+    product_lo.range(2 * DATA_WIDTH - 1, 0) = lo.range(2 * DATA_WIDTH - 1, 0);
+    product_hi.range(2 * DATA_WIDTH - 1, 0) = hi;
+}
+#endif
+
 // MAX Module: For max pooling
-data_t max_module(data_t a, data_t b) {
+inline data_t max_module(data_t a, data_t b) {
     #pragma HLS INLINE
     return (a > b) ? a : b;
 }
 
+// AVG scaling: window sum to mean with a shift for power-of-two windows,
+// otherwise a multiply by the reciprocal of the window size
+inline data_t avg_scale(pool_sum_t sum, bool pow2, ap_uint<4> shift, recip_t recip) {
+    #pragma HLS INLINE
+    return pow2 ? (data_t)(sum >> shift) : (data_t)(sum * recip);
+}
+
+// AVG window setup for n inputs (once per layer, off the MAC path)
+inline void avg_window(window_t n, PEConfig &cfg) {
+    #pragma HLS INLINE
+    
+    cfg.window_size = n;
+    cfg.avg_pow2 = ((n & (n - 1)) == 0);
+    cfg.avg_shift = 0;
+    for (int b = 0; b < COUNT_BITS(MAX_POOL_WINDOW); b++) {
+        #pragma HLS UNROLL
+        if (n[b] == 1) {
+            cfg.avg_shift = b;
+        }
+    }
+    
+    ap_ufixed<32, 12> one = 1;
+    cfg.avg_recip = one / n;
+}
+
 // MIN Module: For ReLU6 clipping
-data_t min_module(data_t a, data_t b) {
+inline data_t min_module(data_t a, data_t b) {
     #pragma HLS INLINE
     return (a < b) ? a : b;
 }
@@ -43,7 +114,7 @@ struct SZDResult {
     bool is_zero;
 };
 
-SZDResult szd_detector(data_t value) {
+inline SZDResult szd_detector(data_t value) {
     #pragma HLS INLINE
     
     SZDResult result;
@@ -53,7 +124,7 @@ SZDResult szd_detector(data_t value) {
 }
 
 // ReLU with SZD
-data_t relu_with_szd(data_t value) {
+inline data_t relu_with_szd(data_t value) {
     #pragma HLS INLINE
     
     SZDResult szd = szd_detector(value);
@@ -61,7 +132,7 @@ data_t relu_with_szd(data_t value) {
 }
 
 // ReLU6 with SZD and MIN
-data_t relu6_with_szd(data_t value) {
+inline data_t relu6_with_szd(data_t value) {
     #pragma HLS INLINE
     
     data_t relu_out = relu_with_szd(value);
@@ -74,15 +145,28 @@ data_t relu6_with_szd(data_t value) {
 
 class PE {
 private:
-    // Weight memory: Stores z weights
-    data_t weight_memory[WEIGHT_MEM_DEPTH];
+    // Weight memory: Two banks of z weights (ping-pong), one feeds the MAC
+    // while the next filter group is loaded into the other
+    data_t weight_memory[2][WEIGHT_MEM_DEPTH];
+    
+    // Sparse metadata per stored weight (line offset, group end)
+    weight_meta_t weight_meta[2][WEIGHT_MEM_DEPTH];
     
     // Accumulator register
-    data_t accumulator;
+    acc_t accumulator;
+    
+    // FC streaming: one accumulator per image of a batch chunk
+    acc_t fc_acc[FC_BATCH_MAX];
+    
+    // AVG window sum (wider than data_t so whole windows cannot overflow)
+    pool_sum_t pool_sum;
     
     // Weight address counter
     addr_t weight_addr;
     
+    // Number of weights loaded per bank
+    addr_t weight_count[2];
+    
     // Input data monitor counter
     ap_uint<16> input_count;
     
@@ -92,39 +176,162 @@ private:
 public:
     // Constructor
     PE() {
-        #pragma HLS ARRAY_PARTITION variable=weight_memory cyclic factor=4
+        #pragma HLS ARRAY_PARTITION variable=weight_memory complete dim=1
+        #pragma HLS ARRAY_PARTITION variable=weight_memory cyclic factor=AXIS_LANES dim=2
         #pragma HLS RESOURCE variable=weight_memory core=RAM_2P_BRAM
+        #pragma HLS ARRAY_PARTITION variable=weight_meta complete dim=1
+        #pragma HLS ARRAY_PARTITION variable=weight_meta cyclic factor=AXIS_LANES dim=2
+        #pragma HLS ARRAY_PARTITION variable=weight_count complete
+        #pragma HLS ARRAY_PARTITION variable=fc_acc complete
         
         accumulator = 0;
+        for (int b = 0; b < FC_BATCH_MAX; b++) {
+            fc_acc[b] = 0;
+        }
+        pool_sum = 0;
         weight_addr = 0;
+        weight_count[0] = 0;
+        weight_count[1] = 0;
         input_count = 0;
         computing = false;
     }
     
-    // Load weight into memory
-    void load_weight(data_t weight, addr_t addr) {
+    // Load weight into memory (weights arrive in address order, so the
+    // last address written defines the filter length)
+    void load_weight(data_t weight, addr_t addr, ap_uint<1> bank) {
+        #pragma HLS INLINE off
+        weight_memory[bank][addr] = weight;
+        weight_count[bank] = addr + 1;
+    }
+    
+    // Load the first `lanes` weights of a packed stream beat starting at addr
+    void load_weight_beat(const axis_beat_t &beat, idx_t lanes, addr_t addr, ap_uint<1> bank) {
+        #pragma HLS INLINE off
+        for (int l = 0; l < AXIS_LANES; l++) {
+            #pragma HLS UNROLL
+            if (l < lanes) {
+                weight_memory[bank][addr + l] = beat.lane[l];
+            }
+        }
+        weight_count[bank] = addr + lanes;
+    }
+    
+    // Load `lanes` compressed entries: non-zero values from one beat, their
+    // metadata from the low byte of each lane of the following beat
+    void load_sparse_beat(const axis_beat_t &values, const axis_beat_t &meta,
+                          idx_t lanes, addr_t addr, ap_uint<1> bank) {
         #pragma HLS INLINE off
-        weight_memory[addr] = weight;
+        for (int l = 0; l < AXIS_LANES; l++) {
+            #pragma HLS UNROLL
+            if (l < lanes) {
+                weight_memory[bank][addr + l] = values.lane[l];
+                weight_meta[bank][addr + l] = meta.lane[l].range(7, 0);
+            }
+        }
+        weight_count[bank] = addr + lanes;
     }
     
+    // FC streaming: accumulate the product of a weight taken straight from
+    // the stream into the accumulator of batch image `image` (first starts
+    // a new neuron, last applies its bias row and completes it). The PE
+    // array forms the product, so INT8 neighbours can share a DSP
+    void stream_mac(product_t product, ap_uint<3> image, bool first, bool last,
+                    bool sign_override, ap_uint<5> out_shift, scale_t out_scale,
+                    data_t &output, bool &valid) {
+        #pragma HLS INLINE
+        fc_acc[image] = first ? (acc_t)product : (acc_t)(fc_acc[image] + product);
+        
+        valid = last;
+        if (last) {
+            data_t result = requantize(fc_acc[image], out_shift, out_scale);
+            output = sign_override ? result : relu_with_szd(result);
+        }
+    }
+    
+    // Global pooling: fold one beat's lane sum into the running channel sum
+    // (first starts a new channel, last completes its mean)
+    void stream_pool(pool_sum_t beat_sum, bool first, bool last, const PEConfig &cfg,
+                     data_t &output, bool &valid) {
+        #pragma HLS INLINE
+        pool_sum = first ? beat_sum : (pool_sum_t)(pool_sum + beat_sum);
+        
+        valid = last;
+        if (last) {
+            output = avg_scale(pool_sum, cfg.avg_pow2, cfg.avg_shift, cfg.avg_recip);
+        }
+    }
+    
+    // First half of a cycle: reset, input select, weight fetch and the
+    // MAX/AVG updates. Returns true when a MAC operand pair (x, w) was
+    // issued; x and w are zero when the MAC is skipped
+    bool issue(
+        data_t input_data[M_SIZE],      // Inputs from m line memories
+        PEConfig cfg,                   // Line select, mode, enables, bank, sparsity
+        data_t bias_psum,              // Bias or partial sum input
+        data_t &mac_input,              // Issued MAC input x
+        data_t &mac_weight,             // Issued MAC weight w
+        bool &stride_request,           // Request next stride
+        bool &valid,                    // Output valid (cleared)
+        bool &skipped                   // MAC skipped on a zero input
+    );
+    
+    // Second half: accumulate the product, then requantise, activate and
+    // emit once the output is complete
+    void retire(
+        product_t product,              // x * w of the issued pair
+        PEConfig cfg,
+        data_t bias_psum,
+        data_t &output,
+        bool &valid
+    );
+    
     // Process one computation cycle
     void compute(
         data_t input_data[M_SIZE],      // Inputs from m line memories
-        ap_uint<5> line_selection,      // Which line to select (0 to M_SIZE-1)
-        bool mac_max_mode,              // true=MAC, false=MAX
-        bool sign_override,             // Sign override for first layer
+        PEConfig cfg,                   // Line select, mode, enables, bank, sparsity
         data_t bias_psum,              // Bias or partial sum input
-        bool enable,                    // Enable computation
-        bool reset,                     // Reset accumulator
         data_t &output,                // Output activation/partial sum
         bool &stride_request,           // Request next stride
-        bool &valid                     // Output valid
+        bool &valid,                    // Output valid
+        bool &skipped                   // MAC skipped on a zero input
+    );
+    
+#ifdef CNN_INT8
+    // Process one cycle of two PEs of the same column (same filter) whose
+    // multiplies share one DSP48E2
+    static void compute_pair(
+        PE &upper,
+        PE &lower,
+        data_t upper_inputs[M_SIZE],
+        data_t lower_inputs[M_SIZE],
+        PEConfig upper_cfg,
+        PEConfig lower_cfg,
+        data_t upper_bias,
+        data_t lower_bias,
+        data_t &upper_output,
+        data_t &lower_output,
+        bool &upper_stride_request,
+        bool &lower_stride_request,
+        bool &upper_valid,
+        bool &lower_valid,
+        bool &upper_skipped,
+        bool &lower_skipped
     );
+#endif
+    
+    // Raw accumulator of the output completed this cycle (weight-stationary
+    // column reduction); PEs that are not continuous keep it until the next
+    // reset
+    acc_t partial_sum() const {
+        #pragma HLS INLINE
+        return accumulator;
+    }
     
     // Reset PE state
     void reset_pe() {
         #pragma HLS INLINE
         accumulator = 0;
+        pool_sum = 0;
         weight_addr = 0;
         input_count = 0;
         computing = false;
@@ -133,20 +340,27 @@ public:
 
 /******************************************************************************
  * STANDALONE PE FUNCTION (for HLS top-level)
+ * Wraps a single PE for unit-level synthesis; pe_array() owns the full grid
  ******************************************************************************/
 
 void pe_unit(
     data_t I[M_SIZE],               // Inputs from m line memories
-    data_t W,                       // Weight input (streamed)
+    data_t W,                       // Weight input (weight load phase)
+    bool weight_load,               // Write W into the idle weight bank
+    addr_t weight_load_addr,        // Weight memory address for W
+    ap_uint<1> weight_bank,         // Active weight bank (ping-pong)
     data_t B_Psum,                  // Bias or partial sum
     ap_uint<5> line_selection,      // Line memory selector
-    bool mac_max_mode,              // true=MAC, false=MAX
+    pe_op_t op,                     // MAC, MAX or AVG
+    window_t window_size,           // MAX/AVG: inputs per output
     bool sign_override,             // Sign override
     bool enable,                    // Enable
     bool reset,                     // Reset
+    bool zero_skip,                 // Skip MACs on zero inputs
     data_t &AC_Psum,               // Output
     bool &stride_request,           // Stride request
-    bool &valid                     // Valid output
+    bool &valid,                    // Valid output
+    bool &skipped                   // MAC skipped this cycle
 );
 
 #endif // PE_UNIT_H
@@ -0,0 +1,99 @@
+/******************************************************************************
+ * @file pool_unit.cpp
+ * @brief Streaming max-pool unit implementation
+ * @description Row buffers of partial maxima; one pooled output per completed window
+ ******************************************************************************/
+
+#include "pool_unit.h"
+
+/******************************************************************************
+ * POOL UNIT IMPLEMENTATION
+ ******************************************************************************/
+
+PoolUnit::PoolUnit() {
+    #pragma HLS ARRAY_PARTITION variable=row_max complete dim=1
+    
+    size = 1;
+    stride = 1;
+    in_w = 0;
+    col_win = 0;
+    col_phase = 0;
+    col = 0;
+    row_win = 0;
+    row_phase = 0;
+}
+
+void PoolUnit::configure(ap_uint<3> pool_size, ap_uint<3> pool_stride, ap_uint<10> conv_w) {
+    #pragma HLS INLINE
+    
+    size = pool_size;
+    stride = pool_stride;
+    in_w = conv_w;
+    col_win = 0;
+    col_phase = 0;
+    col = 0;
+    row_win = 0;
+    row_phase = 0;
+}
+
+bool PoolUnit::process(data_t value, data_t &pooled) {
+    #pragma HLS INLINE
+    
+    bool complete = false;
+    
+    // The element at (row, col) belongs to the window starting at
+    // (row_win, col_win) if its phase is inside the window, and to the
+    // previous window in each direction when windows overlap
+    for (int dr = 0; dr < 2; dr++) {
+        #pragma HLS UNROLL
+        
+        ap_uint<4> r_off = row_phase + (dr ? (ap_uint<4>)stride : (ap_uint<4>)0);
+        bool row_hit = (dr == 0 || row_win > 0) && (r_off < size);
+        ap_uint<1> buf = (row_win - dr) & 1;
+        
+        for (int dc = 0; dc < 2; dc++) {
+            #pragma HLS UNROLL
+            
+            ap_uint<4> c_off = col_phase + (dc ? (ap_uint<4>)stride : (ap_uint<4>)0);
+            bool col_hit = (dc == 0 || col_win > 0) && (c_off < size);
+            ap_uint<10> oc = col_win - dc;
+            
+            if (row_hit && col_hit) {
+                // First element of the window initializes the partial max
+                if (r_off == 0 && c_off == 0) {
+                    row_max[buf][oc] = value;
+                } else if (value > row_max[buf][oc]) {
+                    row_max[buf][oc] = value;
+                }
+                
+                // Bottom-right element completes the window
+                if (r_off == size - 1 && c_off == size - 1) {
+                    pooled = row_max[buf][oc];
+                    complete = true;
+                }
+            }
+        }
+    }
+    
+    // Advance the raster position
+    col++;
+    col_phase++;
+    if (col_phase == stride) {
+        col_phase = 0;
+        col_win++;
+    }
+    
+    if (col == in_w) {
+        col = 0;
+        col_phase = 0;
+        col_win = 0;
+        
+        row_phase++;
+        if (row_phase == stride) {
+            row_phase = 0;
+            row_win++;
+        }
+    }
+    
+    return complete;
+}
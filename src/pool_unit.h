@@ -0,0 +1,46 @@
+/******************************************************************************
+ * @file pool_unit.h
+ * @brief Streaming max-pool unit header
+ * @description Fuses a MAXPOOL window into the output collection of a CONV/FC layer
+ ******************************************************************************/
+
+#ifndef POOL_UNIT_H
+#define POOL_UNIT_H
+
+#include "../include/cnn_types.h"
+
+/******************************************************************************
+ * POOL UNIT CLASS
+ ******************************************************************************/
+
+class PoolUnit {
+private:
+    // Partial maxima of the pooled output rows in flight (at most two
+    // window rows overlap when pool_size <= 2 * pool_stride)
+    data_t row_max[2][LINE_MEM_WIDTH];
+    
+    // Pooling window
+    ap_uint<3> size;
+    ap_uint<3> stride;
+    ap_uint<10> in_w;           // Un-pooled (conv output) row width
+    
+    // Position of the incoming element, kept as window index + phase
+    // (position = win * stride + phase) to avoid dividers
+    ap_uint<10> col_win;
+    ap_uint<3> col_phase;
+    ap_uint<10> col;
+    ap_uint<10> row_win;
+    ap_uint<3> row_phase;
+    
+public:
+    PoolUnit();
+    
+    // Start a new layer: window size/stride and un-pooled row width
+    void configure(ap_uint<3> pool_size, ap_uint<3> pool_stride, ap_uint<10> conv_w);
+    
+    // Consume one activation in raster order; returns true with the window
+    // maximum when this element completes a pooling window
+    bool process(data_t value, data_t &pooled);
+};
+
+#endif // POOL_UNIT_H
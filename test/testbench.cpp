@@ -1,8 +1,823 @@
 /******************************************************************************
- * @file testbench.cpp  
- * @brief Absolute minimal testbench - NO function calls
+ * @file testbench.cpp
+ * @brief C-simulation testbench
+ * @description Behavioural checks of the INT8 DSP pairing, the FClast
+ *              classification and the layer checks, plus small layers run
+ *              end to end through the PE array.
+ *              Prints each failure and returns non-zero if any check fails
+ ******************************************************************************/
+
+#include <cstdio>
+#include "pe_unit.h"
+#include "classify_unit.h"
+#include "pe_array.h"
+
+/******************************************************************************
+ * HELPERS
+ ******************************************************************************/
+
+static int failures = 0;
+
+static void check(bool condition, const char *name) {
+    if (!condition) {
+        printf("  FAIL: %s\n", name);
+        failures++;
+    }
+}
+
+// data_t from a raw two's-complement code (FRAC_BITS fractional bits)
+static data_t from_raw(int raw) {
+    return (data_t)((float)raw / (float)(1 << FRAC_BITS));
+}
+
+// Deterministic test values: multiples of 1/4 in [-range, range]
+static unsigned lcg_state = 12345;
+
+static data_t next_value(int range) {
+    lcg_state = lcg_state * 1103515245u + 12345u;
+    int steps = 8 * range + 1;
+    int q = (int)((lcg_state >> 16) % (unsigned)steps) - 4 * range;
+    return (data_t)((float)q / 4.0f);
+}
+
+// Stream a vector as one beat-aligned row (the last beat zero-padded)
+static void write_row(hls::stream<axis_beat_t> &stream, const data_t *values, int count) {
+    for (int base = 0; base < count; base += AXIS_LANES) {
+        axis_beat_t beat;
+        for (int l = 0; l < AXIS_LANES; l++) {
+            beat.lane[l] = (base + l < count) ? values[base + l] : TO_FIXED(0);
+        }
+        stream.write(beat);
+    }
+}
+
+// Run one layer through the PE array until it reports done; every output
+// lane lands in out. Returns the number of lanes, or -1 if the layer hangs
+static int run_layer(LayerConfig cfg, ActivationRoute route, int batch,
+                     hls::stream<axis_beat_t> &input, hls::stream<axis_beat_t> &weights,
+                     hls::stream<data_t> &biases, data_t *out, int max_out) {
+    hls::stream<axis_beat_t> output;
+    bool done = false, pass_start;
+    ap_uint<32> cycles, skipped;
+    
+    for (int cycle = 0; cycle == 0 || !done; cycle++) {
+        if (cycle == 200000) {
+            return -1;
+        }
+        pe_array(input, weights, biases, output, cfg, route, batch, cycle == 0,
+                 done, pass_start, cycles, skipped);
+    }
+    
+    int count = 0;
+    while (!output.empty()) {
+        axis_beat_t beat = output.read();
+        for (int l = 0; l < AXIS_LANES; l++) {
+            if (count < max_out) {
+                out[count] = beat.lane[l];
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+// Compare one output with the reference; print the first few mismatches
+static int mismatches = 0;
+
+static void check_output(data_t got, data_t expected, const char *name, int index) {
+    if (got != expected) {
+        if (mismatches < 5) {
+            printf("  %s [%d]: got %f expected %f\n", name, index,
+                   got.to_double(), expected.to_double());
+        }
+        mismatches++;
+        failures++;
+    }
+}
+
+/******************************************************************************
+ * TEST 1: INT8 DSP PAIRING
+ * Both products of dual_mac_product must match two separate multiplies, and
+ * the modes that load a different weight into every PE must stay off
+ ******************************************************************************/
+
+static void test_int8_pairing() {
+    printf("Test 1: INT8 DSP pairing\n");
+    
+#ifdef CNN_INT8
+    int pairs = 0;
+    for (int w = -128; w < 128; w += 3) {
+        for (int a = -128; a < 128; a += 5) {
+            for (int b = -128; b < 128; b += 7) {
+                data_t weight = from_raw(w);
+                data_t input_hi = from_raw(a);
+                data_t input_lo = from_raw(b);
+                product_t product_hi, product_lo;
+                
+                dual_mac_product(weight, input_hi, input_lo, product_hi, product_lo);
+                
+                if (product_hi != mac_product(input_hi, weight) ||
+                    product_lo != mac_product(input_lo, weight)) {
+                    printf("  w=%d a=%d b=%d: hi %f lo %f\n", w, a, b,
+                           product_hi.to_double(), product_lo.to_double());
+                    failures++;
+                }
+                pairs++;
+            }
+        }
+    }
+    printf("  %d operand triples\n", pairs);
+#else
+    printf("  16-bit build: one MAC per DSP, no pairing\n");
+#endif
+    
+    // Weight-stationary PEs hold their own kernel rows, which PE pairs
+    // cannot share
+    LayerConfig cfg;
+    cfg.layer_type = CONV;
+    cfg.dataflow = DATAFLOW_WEIGHT_STATIONARY;
+    check(IS_WEIGHT_STATIONARY(cfg) == (MACS_PER_DSP == 1),
+          "weight-stationary only without PE pairs");
+}
+
+/******************************************************************************
+ * TEST 2: FCLAST CLASSIFICATION
+ * The CU sees exactly num_classes scores (only the row lanes of each output
+ * beat); it must finish on the last one and report the argmax, including
+ * class 0 and all-negative scores
+ ******************************************************************************/
+
+static void run_classification(const data_t *scores, int classes, int expected, const char *name) {
+    LayerConfig cfg;
+    cfg.layer_type = FC;
+    cfg.is_fc_last = true;
+    cfg.num_classes = classes;
+    
+    data_t output_data;
+    bool output_valid, done = false;
+    int class_number = -1;
+    bool early = false;
+    
+    for (int c = 0; c < classes; c++) {
+        // An idle cycle between scores must not count as a class
+        classify_unit(0, false, 0, cfg, output_data, output_valid, class_number, done);
+        early = early || done;
+        
+        classify_unit(scores[c], true, 0, cfg, output_data, output_valid, class_number, done);
+        if (c < classes - 1) {
+            early = early || done;
+        }
+    }
+    
+    check(!early, name);
+    check(done, name);
+    check(class_number == expected, name);
+    
+    // Leave the FClast layer so the CU returns to idle
+    cfg.is_fc_last = false;
+    classify_unit(0, false, 1, cfg, output_data, output_valid, class_number, done);
+}
+
+static void test_fc_last_classification() {
+    printf("Test 2: FClast classification\n");
+    
+    const int classes = 10;
+    data_t scores[classes];
+    
+    // Negative scores, maximum at class 0 (a zero padding lane would win)
+    for (int c = 0; c < classes; c++) {
+        scores[c] = from_raw(-(1 << FRAC_BITS) - 3 * c);
+    }
+    run_classification(scores, classes, 0, "argmax at class 0 of negative scores");
+    
+    // Maximum at the last class
+    for (int c = 0; c < classes; c++) {
+        scores[c] = from_raw(c - 5);
+    }
+    run_classification(scores, classes, classes - 1, "argmax at the last class");
+    
+    // Single-class layer finishes on its only score
+    scores[0] = from_raw(-7);
+    run_classification(scores, 1, 0, "single class");
+}
+
+/******************************************************************************
+ * TEST 3: UNSUPPORTED LAYERS
+ * The IEC stops on layers the datapath cannot execute
+ ******************************************************************************/
+
+static void test_layer_checks() {
+    printf("Test 3: Unsupported layers\n");
+    
+    // 3×3×28 = 252 weights fit a PE, 3×3×29 = 261 do not; FC layers stream
+    // their weights
+    LayerConfig conv;
+    conv.layer_type = CONV;
+    conv.kernel_h = 3;
+    conv.kernel_w = 3;
+    conv.stride = 1;
+    conv.padding = 1;
+    conv.kernel_d = 28;
+    check(!LAYER_UNSUPPORTED(conv), "3x3x28 filter runs");
+    conv.kernel_d = 29;
+    check(LAYER_UNSUPPORTED(conv), "3x3x29 filter is rejected");
+    conv.kernel_d = 64;
+    conv.weight_entries = 200;
+    check(!LAYER_UNSUPPORTED(conv), "compressed 3x3x64 filter with 200 entries runs");
+    conv.layer_type = FC;
+    conv.weight_entries = 0;
+    conv.kernel_d = 1024;
+    check(!LAYER_UNSUPPORTED(conv), "FC layer streams any filter size");
+    
+    LayerConfig pointwise;
+    pointwise.layer_type = CONV;
+    pointwise.kernel_h = 1;
+    pointwise.kernel_w = 1;
+    pointwise.stride = 1;
+    pointwise.padding = 0;
+    pointwise.kernel_d = 256;
+    check(!LAYER_UNSUPPORTED(pointwise), "pointwise kernel_d = 256 runs");
+    pointwise.kernel_d = 257;
+    check(LAYER_UNSUPPORTED(pointwise), "pointwise kernel_d = 257 is rejected");
+    pointwise.kernel_d = 1024;
+    check(LAYER_UNSUPPORTED(pointwise), "pointwise kernel_d = 1024 is rejected");
+    
+    // Depthwise rows hold N_SIZE channels per pixel in one line memory
+    LayerConfig depthwise;
+    depthwise.layer_type = DWCONV;
+    depthwise.kernel_h = 3;
+    depthwise.kernel_w = 3;
+    depthwise.input_w = LINE_MEM_WIDTH / N_SIZE;
+    depthwise.output_w = LINE_MEM_WIDTH / N_SIZE;
+    check(!LAYER_UNSUPPORTED(depthwise), "depthwise row of LINE_MEM_WIDTH values runs");
+    depthwise.input_w++;
+    check(LAYER_UNSUPPORTED(depthwise), "wider depthwise row is rejected");
+    depthwise.input_w--;
+    depthwise.pool_size = 2;
+    check(LAYER_UNSUPPORTED(depthwise), "depthwise layer with a fused pool is rejected");
+    
+    // Pooling rows share the depthwise layout and limit
+    LayerConfig pool;
+    pool.layer_type = MAXPOOL;
+    pool.kernel_h = 2;
+    pool.kernel_w = 2;
+    pool.stride = 2;
+    pool.input_w = LINE_MEM_WIDTH / N_SIZE;
+    pool.output_w = pool.input_w / 2;
+    check(!LAYER_UNSUPPORTED(pool), "max-pool row of LINE_MEM_WIDTH values runs");
+    pool.input_w++;
+    check(LAYER_UNSUPPORTED(pool), "wider max-pool row is rejected");
+    pool.layer_type = AVGPOOL;
+    check(LAYER_UNSUPPORTED(pool), "wider average-pool row is rejected");
+    
+    LayerConfig gpool;
+    gpool.layer_type = GAVGPOOL;
+    gpool.input_h = 64;
+    gpool.input_w = 64;
+    check(!LAYER_UNSUPPORTED(gpool), "64x64 global pool runs");
+    gpool.input_w = 65;
+    check(LAYER_UNSUPPORTED(gpool), "64x65 global pool is rejected");
+    
+    LayerConfig residual;
+    residual.add_residual = true;
+    check(!LAYER_UNSUPPORTED(residual), "residual add runs");
+    residual.pool_size = 2;
+    check(LAYER_UNSUPPORTED(residual), "residual add with a fused pool is rejected");
+}
+
+/******************************************************************************
+ * TEST 4: POINTWISE LAYER
+ * 3×7 map of 37 channels, two filter groups: three pixel blocks (the last
+ * one partial) per group, each started only once its pixels are resident
+ ******************************************************************************/
+
+static void run_pointwise_layer(int batch, const char *name) {
+    const int h = 3, w = 7, depth = 37, groups = 2, max_batch = 3;
+    const int pixels = h * w, filters = groups * N_SIZE;
+    const int vec_lanes = ((N_SIZE + AXIS_LANES - 1) / AXIS_LANES) * AXIS_LANES;
+    
+    LayerConfig cfg;
+    cfg.layer_type = CONV;
+    cfg.kernel_h = 1;
+    cfg.kernel_w = 1;
+    cfg.kernel_d = depth;
+    cfg.num_filters = filters;
+    cfg.input_h = h;
+    cfg.input_w = w;
+    cfg.input_c = depth;
+    cfg.output_h = h;
+    cfg.output_w = w;
+    cfg.output_c = filters;
+    cfg.stride = 1;
+    cfg.padding = 0;
+    cfg.nl = groups;
+    cfg.activation = ACT_NONE;
+    
+    static data_t in[max_batch][pixels][depth], weight[filters][depth], bias[filters];
+    for (int b = 0; b < batch; b++) {
+        for (int p = 0; p < pixels; p++) {
+            for (int c = 0; c < depth; c++) {
+                in[b][p][c] = next_value(1);
+            }
+        }
+    }
+    for (int f = 0; f < filters; f++) {
+        bias[f] = next_value(1);
+        for (int c = 0; c < depth; c++) {
+            weight[f][c] = next_value(1);
+        }
+    }
+    
+    // Every filter group re-reads each image's map in turn; filters and
+    // biases by group, loaded once for the whole batch
+    hls::stream<axis_beat_t> input, weights;
+    hls::stream<data_t> biases;
+    for (int g = 0; g < groups; g++) {
+        for (int b = 0; b < batch; b++) {
+            for (int p = 0; p < pixels; p++) {
+                write_row(input, in[b][p], depth);
+            }
+        }
+    }
+    for (int f = 0; f < filters; f++) {
+        write_row(weights, weight[f], depth);
+        biases.write(bias[f]);
+    }
+    
+    const int lanes = groups * batch * pixels * vec_lanes;
+    static data_t out[groups * max_batch * pixels * vec_lanes];
+    int count = run_layer(cfg, ActivationRoute(), batch, input, weights, biases, out, lanes);
+    check(count == lanes, name);
+    check(input.empty() && weights.empty() && biases.empty(), name);
+    
+    // Output: per group and image, one beat-aligned N_SIZE filter vector
+    // per pixel
+    mismatches = 0;
+    for (int f = 0; f < filters && count > 0; f++) {
+        for (int b = 0; b < batch; b++) {
+            for (int p = 0; p < pixels; p++) {
+                acc_t acc = bias[f];
+                for (int c = 0; c < depth; c++) {
+                    acc += mac_product(in[b][p][c], weight[f][c]);
+                }
+                int index = (((f / N_SIZE) * batch + b) * pixels + p) * vec_lanes + f % N_SIZE;
+                check_output(out[index], requantize(acc, 0, 1), name, index);
+            }
+        }
+    }
+}
+
+static void test_pointwise_layer() {
+    printf("Test 4: Pointwise layer\n");
+    
+    run_pointwise_layer(1, "pointwise");
+}
+
+/******************************************************************************
+ * TEST 5: DEPTHWISE LAYER
+ * 9×10 map, 3×3 filters with padding 1, two channel groups: a full band of
+ * output rows and a partial one per group, rows of N_SIZE channels per pixel
+ ******************************************************************************/
+
+static void test_depthwise_layer() {
+    printf("Test 5: Depthwise layer\n");
+    
+    const int h = 9, w = 10, k = 3, groups = 2;
+    const int channels = groups * N_SIZE;
+    const int row_lanes = ((w * N_SIZE + AXIS_LANES - 1) / AXIS_LANES) * AXIS_LANES;
+    
+    LayerConfig cfg;
+    cfg.layer_type = DWCONV;
+    cfg.kernel_h = k;
+    cfg.kernel_w = k;
+    cfg.kernel_d = 1;
+    cfg.num_filters = channels;
+    cfg.input_h = h;
+    cfg.input_w = w;
+    cfg.input_c = channels;
+    cfg.output_h = h;
+    cfg.output_w = w;
+    cfg.output_c = channels;
+    cfg.stride = 1;
+    cfg.padding = 1;
+    cfg.nl = groups;
+    cfg.activation = ACT_NONE;
+    
+    static data_t in[channels][h][w], weight[channels][k * k], bias[channels];
+    for (int c = 0; c < channels; c++) {
+        bias[c] = next_value(1);
+        for (int t = 0; t < k * k; t++) {
+            weight[c][t] = next_value(1);
+        }
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                in[c][y][x] = next_value(1);
+            }
+        }
+    }
+    
+    // Each group streams its channels interleaved pixel by pixel, one
+    // filter per channel
+    hls::stream<axis_beat_t> input, weights;
+    hls::stream<data_t> biases;
+    for (int g = 0; g < groups; g++) {
+        for (int y = 0; y < h; y++) {
+            data_t row[w * N_SIZE];
+            for (int x = 0; x < w; x++) {
+                for (int j = 0; j < N_SIZE; j++) {
+                    row[x * N_SIZE + j] = in[g * N_SIZE + j][y][x];
+                }
+            }
+            write_row(input, row, w * N_SIZE);
+        }
+    }
+    for (int c = 0; c < channels; c++) {
+        write_row(weights, weight[c], k * k);
+        biases.write(bias[c]);
+    }
+    
+    static data_t out[groups * h * row_lanes];
+    int count = run_layer(cfg, ActivationRoute(), 1, input, weights, biases,
+                          out, groups * h * row_lanes);
+    check(count == groups * h * row_lanes, "depthwise output size");
+    check(input.empty() && weights.empty() && biases.empty(), "depthwise streams consumed");
+    
+    // Output: per group, one beat-aligned row of w pixels × N_SIZE channels
+    mismatches = 0;
+    for (int c = 0; c < channels && count > 0; c++) {
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                acc_t acc = bias[c];
+                for (int ty = 0; ty < k; ty++) {
+                    for (int tx = 0; tx < k; tx++) {
+                        int iy = y + ty - 1, ix = x + tx - 1;
+                        if (iy >= 0 && iy < h && ix >= 0 && ix < w) {
+                            acc += mac_product(in[c][iy][ix], weight[c][ty * k + tx]);
+                        }
+                    }
+                }
+                int index = ((c / N_SIZE) * h + y) * row_lanes + x * N_SIZE + c % N_SIZE;
+                check_output(out[index], requantize(acc, 0, 1), "depthwise", index);
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * TEST 6: POOLING LAYERS
+ * 3×3 max and average pools with stride 2 and padding 1 over an 11×9 map:
+ * strided bands, a partial last band and padded taps (zeros). The average
+ * divides by 9 through the reciprocal multiply
+ ******************************************************************************/
+
+static void run_pool_layer(layer_type_t type, const char *name) {
+    const int h = 11, w = 9, k = 3, stride = 2, pad = 1;
+    const int out_h = (h + 2 * pad - k) / stride + 1, out_w = (w + 2 * pad - k) / stride + 1;
+    const int row_lanes = ((out_w * N_SIZE + AXIS_LANES - 1) / AXIS_LANES) * AXIS_LANES;
+    
+    LayerConfig cfg;
+    cfg.layer_type = type;
+    cfg.kernel_h = k;
+    cfg.kernel_w = k;
+    cfg.kernel_d = 1;
+    cfg.input_h = h;
+    cfg.input_w = w;
+    cfg.input_c = N_SIZE;
+    cfg.output_h = out_h;
+    cfg.output_w = out_w;
+    cfg.output_c = N_SIZE;
+    cfg.stride = stride;
+    cfg.padding = pad;
+    cfg.nl = 1;
+    cfg.activation = ACT_NONE;
+    
+    static data_t in[N_SIZE][h][w];
+    hls::stream<axis_beat_t> input, weights;
+    hls::stream<data_t> biases;
+    for (int y = 0; y < h; y++) {
+        data_t row[w * N_SIZE];
+        for (int x = 0; x < w; x++) {
+            for (int j = 0; j < N_SIZE; j++) {
+                in[j][y][x] = next_value(2);
+                row[x * N_SIZE + j] = in[j][y][x];
+            }
+        }
+        write_row(input, row, w * N_SIZE);
+    }
+    
+    static data_t out[out_h * row_lanes];
+    int count = run_layer(cfg, ActivationRoute(), 1, input, weights, biases,
+                          out, out_h * row_lanes);
+    check(count == out_h * row_lanes, name);
+    check(input.empty(), name);
+    
+    PEConfig window;
+    avg_window(k * k, window);
+    
+    mismatches = 0;
+    for (int j = 0; j < N_SIZE && count > 0; j++) {
+        for (int y = 0; y < out_h; y++) {
+            for (int x = 0; x < out_w; x++) {
+                data_t max_value = DATA_MIN;
+                pool_sum_t sum = 0;
+                for (int ty = 0; ty < k; ty++) {
+                    for (int tx = 0; tx < k; tx++) {
+                        int iy = y * stride + ty - pad, ix = x * stride + tx - pad;
+                        data_t v = (iy >= 0 && iy < h && ix >= 0 && ix < w) ?
+                                   in[j][iy][ix] : TO_FIXED(0);
+                        max_value = (v > max_value) ? v : max_value;
+                        sum += v;
+                    }
+                }
+                data_t expected = (type == MAXPOOL) ? max_value :
+                                  avg_scale(sum, window.avg_pow2, window.avg_shift,
+                                            window.avg_recip);
+                int index = y * row_lanes + x * N_SIZE + j;
+                check_output(out[index], expected, name, index);
+            }
+        }
+    }
+}
+
+static void test_pooling_layers() {
+    printf("Test 6: Pooling layers\n");
+    
+    run_pool_layer(MAXPOOL, "max pool");
+    run_pool_layer(AVGPOOL, "average pool");
+}
+
+/******************************************************************************
+ * TEST 7: FC BATCH
+ * A two-group FC layer over a batch of 5: a chunk of FC_BATCH_MAX images
+ * shares every weight beat (their input beats interleaved), then the last
+ * image runs on its own against the group's weights streamed again
+ ******************************************************************************/
+
+static void test_fc_batch() {
+    printf("Test 7: FC batch\n");
+    
+    const int inputs = 20, groups = 2, batch = 5;
+    const int neurons = groups * TOTAL_PES;
+    const int row_beats = (inputs + AXIS_LANES - 1) / AXIS_LANES;
+    const int group_lanes = FC_BEATS_PER_INPUT * AXIS_LANES;
+    
+    LayerConfig cfg;
+    cfg.layer_type = FC;
+    cfg.kernel_h = 1;
+    cfg.kernel_w = 1;
+    cfg.kernel_d = 1;
+    cfg.num_filters = neurons;
+    cfg.input_h = 1;
+    cfg.input_w = inputs;
+    cfg.input_c = 1;
+    cfg.output_h = 1;
+    cfg.output_w = neurons;
+    cfg.output_c = 1;
+    cfg.stride = 1;
+    cfg.padding = 0;
+    cfg.nl = groups;
+    cfg.activation = ACT_NONE;
+    
+    static data_t in[batch][inputs], weight[neurons][inputs], bias[neurons];
+    for (int b = 0; b < batch; b++) {
+        for (int k = 0; k < inputs; k++) {
+            in[b][k] = next_value(1);
+        }
+    }
+    for (int n = 0; n < neurons; n++) {
+        bias[n] = next_value(1);
+        for (int k = 0; k < inputs; k++) {
+            weight[n][k] = next_value(1);
+        }
+    }
+    
+    // Per group and chunk: the chunk's input beats interleaved image by
+    // image, and the group's weights input-major with the bias row last
+    hls::stream<axis_beat_t> input, weights;
+    hls::stream<data_t> biases;
+    for (int g = 0; g < groups; g++) {
+        for (int first = 0; first < batch; first += FC_BATCH_MAX) {
+            int images = (batch - first < FC_BATCH_MAX) ? batch - first : FC_BATCH_MAX;
+            for (int beat = 0; beat < row_beats; beat++) {
+                for (int b = first; b < first + images; b++) {
+                    int count = (inputs - beat * AXIS_LANES < AXIS_LANES) ?
+                                inputs - beat * AXIS_LANES : AXIS_LANES;
+                    write_row(input, &in[b][beat * AXIS_LANES], count);
+                }
+            }
+            for (int k = 0; k <= inputs; k++) {
+                data_t row[group_lanes];
+                for (int p = 0; p < group_lanes; p++) {
+                    int n = g * TOTAL_PES + p;
+                    row[p] = (p >= TOTAL_PES) ? TO_FIXED(0) :
+                             (k == inputs) ? bias[n] : weight[n][k];
+                }
+                write_row(weights, row, group_lanes);
+            }
+        }
+    }
+    
+    static data_t out[neurons * batch];
+    int count = run_layer(cfg, ActivationRoute(), batch, input, weights, biases,
+                          out, neurons * batch);
+    check(count == neurons * batch, "FC batch output size");
+    check(input.empty() && weights.empty(), "FC batch streams consumed");
+    
+    // Output: per neuron group, each image's TOTAL_PES neurons in turn
+    mismatches = 0;
+    for (int n = 0; n < neurons && count > 0; n++) {
+        for (int b = 0; b < batch; b++) {
+            acc_t acc = bias[n];
+            for (int k = 0; k < inputs; k++) {
+                acc += mac_product(in[b][k], weight[n][k]);
+            }
+            int index = ((n / TOTAL_PES) * batch + b) * TOTAL_PES + n % TOTAL_PES;
+            check_output(out[index], requantize(acc, 0, 1), "FC batch", index);
+        }
+    }
+}
+
+/******************************************************************************
+ * TEST 8: RESIDUAL JOINS
+ * A pointwise layer saves its map in the skip buffer; an ELTWISE_ADD layer
+ * with ReLU and a pointwise layer with a fused join then add it. Values
+ * span most of the data_t range, so many sums overflow and must saturate
+ ******************************************************************************/
+
+// Test value of up to 3/4 of the data_t range (saturation cases)
+static data_t large_value() {
+    return next_value(1) * (data_t)(0.75 * (1 << (INT_BITS - 1)));
+}
+
+// Reference join: exact sum clipped to the data_t range
+static data_t saturated_sum(data_t a, data_t b) {
+    double sum = a.to_double() + b.to_double();
+    double high = (double)(1 << (INT_BITS - 1)) - 1.0 / (1 << FRAC_BITS);
+    double low = -(double)(1 << (INT_BITS - 1));
+    return (data_t)((sum > high) ? high : (sum < low) ? low : sum);
+}
+
+// One-group pointwise layer over pixels × depth; outputs pixel-major
+static void run_residual_pointwise(const data_t in[][3], const data_t weight[][3],
+                                   const data_t *bias, int pixels, ActivationRoute route,
+                                   data_t *out, int max_out, const char *name) {
+    const int depth = 3;
+    
+    LayerConfig cfg;
+    cfg.layer_type = CONV;
+    cfg.kernel_h = 1;
+    cfg.kernel_w = 1;
+    cfg.kernel_d = depth;
+    cfg.num_filters = N_SIZE;
+    cfg.input_h = 1;
+    cfg.input_w = pixels;
+    cfg.input_c = depth;
+    cfg.output_h = 1;
+    cfg.output_w = pixels;
+    cfg.output_c = N_SIZE;
+    cfg.stride = 1;
+    cfg.padding = 0;
+    cfg.nl = 1;
+    cfg.activation = ACT_NONE;
+    cfg.save_output = route.skip_save;
+    cfg.add_residual = route.skip_add;
+    
+    hls::stream<axis_beat_t> input, weights;
+    hls::stream<data_t> biases;
+    for (int p = 0; p < pixels; p++) {
+        write_row(input, in[p], depth);
+    }
+    for (int f = 0; f < N_SIZE; f++) {
+        write_row(weights, weight[f], depth);
+        biases.write(bias[f]);
+    }
+    
+    int count = run_layer(cfg, route, 1, input, weights, biases, out, max_out);
+    check(count == max_out, name);
+}
+
+static void test_residual_joins() {
+    printf("Test 8: Residual joins\n");
+    
+    const int pixels = 10, depth = 3;
+    const int vec_lanes = ((N_SIZE + AXIS_LANES - 1) / AXIS_LANES) * AXIS_LANES;
+    const int lanes = pixels * vec_lanes;
+    
+    static data_t in[2][pixels][depth], weight[2][N_SIZE][depth], bias[2][N_SIZE];
+    static data_t x[pixels][N_SIZE];
+    for (int layer = 0; layer < 2; layer++) {
+        for (int p = 0; p < pixels; p++) {
+            for (int c = 0; c < depth; c++) {
+                in[layer][p][c] = large_value();
+            }
+        }
+        for (int f = 0; f < N_SIZE; f++) {
+            bias[layer][f] = large_value();
+            for (int c = 0; c < depth; c++) {
+                weight[layer][f][c] = next_value(1);
+            }
+        }
+    }
+    for (int p = 0; p < pixels; p++) {
+        for (int f = 0; f < N_SIZE; f++) {
+            x[p][f] = large_value();
+        }
+    }
+    
+    // Reference pointwise outputs of both layers, before any join
+    static data_t conv[2][pixels][N_SIZE];
+    for (int layer = 0; layer < 2; layer++) {
+        for (int p = 0; p < pixels; p++) {
+            for (int f = 0; f < N_SIZE; f++) {
+                acc_t acc = bias[layer][f];
+                for (int c = 0; c < depth; c++) {
+                    acc += mac_product(in[layer][p][c], weight[layer][f][c]);
+                }
+                conv[layer][p][f] = requantize(acc, 0, 1);
+            }
+        }
+    }
+    
+    // Layer 1 saves its map
+    ActivationRoute save;
+    save.skip_save = true;
+    static data_t saved[lanes];
+    run_residual_pointwise(in[0], weight[0], bias[0], pixels, save, saved, lanes,
+                           "residual save output size");
+    
+    // ELTWISE_ADD with ReLU: an input of the same shape joins the saved map
+    LayerConfig cfg;
+    cfg.layer_type = ELTWISE_ADD;
+    cfg.input_h = pixels;
+    cfg.input_w = N_SIZE;
+    cfg.input_c = 1;
+    cfg.output_h = pixels;
+    cfg.output_w = N_SIZE;
+    cfg.output_c = 1;
+    cfg.nl = 1;
+    cfg.activation = ACT_RELU;
+    cfg.add_residual = true;
+    
+    ActivationRoute add;
+    add.skip_add = true;
+    hls::stream<axis_beat_t> input, weights;
+    hls::stream<data_t> biases;
+    for (int p = 0; p < pixels; p++) {
+        write_row(input, x[p], N_SIZE);
+    }
+    static data_t eltwise[lanes];
+    int count = run_layer(cfg, add, 1, input, weights, biases, eltwise, lanes);
+    check(count == lanes && input.empty(), "ELTWISE_ADD output size");
+    
+    // Layer 2 with the join fused into its output collection
+    static data_t fused[lanes];
+    run_residual_pointwise(in[1], weight[1], bias[1], pixels, add, fused, lanes,
+                           "fused join output size");
+    
+    mismatches = 0;
+    for (int p = 0; p < pixels; p++) {
+        for (int f = 0; f < N_SIZE; f++) {
+            int index = p * vec_lanes + f;
+            data_t sum = saturated_sum(x[p][f], conv[0][p][f]);
+            check_output(saved[index], conv[0][p][f], "residual save", index);
+            check_output(eltwise[index], (sum < 0) ? TO_FIXED(0) : sum, "ELTWISE_ADD", index);
+            check_output(fused[index], saturated_sum(conv[1][p][f], conv[0][p][f]),
+                         "fused join", index);
+        }
+    }
+}
+
+/******************************************************************************
+ * TEST 9: BATCHED LAYER
+ * The Test 4 pointwise layer over a batch of 3: each filter group stays
+ * resident while every image's map streams through it
+ ******************************************************************************/
+
+static void test_batched_layer() {
+    printf("Test 9: Batched layer\n");
+    
+    run_pointwise_layer(3, "pointwise batch");
+}
+
+/******************************************************************************
+ * MAIN
  ******************************************************************************/
 
 int main() {
-    return 0;  // Simply return success
+    test_int8_pairing();
+    test_fc_last_classification();
+    test_layer_checks();
+    test_pointwise_layer();
+    test_depthwise_layer();
+    test_pooling_layers();
+    test_fc_batch();
+    test_residual_joins();
+    test_batched_layer();
+    
+    if (failures == 0) {
+        printf("PASSED\n");
+    } else {
+        printf("FAILED: %d check(s)\n", failures);
+    }
+    return (failures == 0) ? 0 : 1;
 }